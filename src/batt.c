@@ -21,6 +21,9 @@
  */
 
 #include "batt.h"
+#include "common.h"
+#include "counters.h"
+#include <float.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -51,150 +54,462 @@ const double	kLinearRegionEndVoltageMagic = 4.021363851351348;
  *	without introducing control flow statements.
  */
 const double	kSigmoidMaxScale = 50;
+const double	kSigmoidMinSupport = 1E-300;
 
-void
-batteryUpdate(
-	Batt *	B,
-	double	timeNow,
-	double	currentLoad,
-	double	voltageLoad)
+/*
+ *	Five-point Gauss–Legendre rule on [-1, 1]. The runtime predictor applies
+ *	it once per segment of the discharge curve, so every prediction costs a
+ *	fixed number of `socToVoltage` evaluations regardless of the horizon.
+ */
+const double	kGaussLegendreNodes[] = {
+			-0.9061798459386640, -0.5384693101056831, 0.0,
+			0.5384693101056831, 0.9061798459386640};
+const double	kGaussLegendreWeights[] = {
+			0.2369268850561891, 0.4786286704993665, 0.5688888888888889,
+			0.4786286704993665, 0.2369268850561891};
+const size_t	kGaussLegendreOrder = sizeof(kGaussLegendreNodes) / sizeof(kGaussLegendreNodes[0]);
+
+/*
+ *	Bounds for the safeguarded Newton iterations used by the runtime predictor.
+ */
+const int	kRootFindingMaxIterations = 12;
+const double	kRootFindingTolerance = 1E-9;
+
+/*
+ *	Step-size control for `batteryIntegrate`. The Bogacki–Shampine pair has a
+ *	third-order solution with an embedded second-order error estimate.
+ */
+const double	kIntegratorSafetyFactor = 0.9;
+const double	kIntegratorMinScale = 0.2;
+const double	kIntegratorMaxScale = 5.0;
+
+#define	BATT_KERNEL_REAL		double
+#define	BATT_KERNEL_STATE		Batt
+#define	BATT_KERNEL_NAME(name)		name
+#define	BATT_KERNEL_SUPPORT_MAX		UxHwDoubleSupportMax
+#define	BATT_KERNEL_SUPPORT_MIN		UxHwDoubleSupportMin
+#define	BATT_KERNEL_MIN_SUPPORT		kSigmoidMinSupport
+#include "battkernel.inc"
+
+/**
+ *	@brief	Time for a constant load power to discharge a battery between two states of charge.
+ *
+ *		At unit load power and no leakage, the returned time in seconds equals
+ *		the energy in joules delivered between the two states of charge.
+ *
+ *	@param	totalCapacity	: Capacity of the battery (C).
+ *	@param	currentLeak	: Leakage current (A).
+ *	@param	powerLoad	: Power drawn by the load (W).
+ *	@param	socLow		: Final state of charge.
+ *	@param	socHigh		: Initial state of charge.
+ *	@return			: Discharge time (s).
+ */
+static double
+dischargeTime(double totalCapacity, double currentLeak, double powerLoad, double socLow, double socHigh)
 {
-	B->timeNow = timeNow;
-	if (!B->dead)
+	double	time = 0.0;
+
+	/*
+	 *	With `current = powerLoad / voltage + currentLeak` (as in `batteryUpdate`), the
+	 *	time to move from `socHigh` to `socLow` is
+	 *
+	 *		totalCapacity * integral(voltage(soc) / (powerLoad + currentLeak * voltage(soc)), socLow, socHigh).
+	 *
+	 *	The interval is split at the knees of the discharge curve so that each
+	 *	quadrature only sees one smooth segment. The split points are clamped
+	 *	rather than branched on, so uncertain bounds propagate unchanged.
+	 */
+	double	bounds[] = {
+			socLow,
+			fmin(fmax(kLinearRegionStartSoc / 100, socLow), socHigh),
+			fmin(fmax(kLinearRegionEndSoc / 100, socLow), socHigh),
+			socHigh};
+
+	for (size_t i = 0; i < sizeof(bounds) / sizeof(bounds[0]) - 1; i++)
 	{
+		double	halfWidth = (bounds[i + 1] - bounds[i]) / 2;
+		double	midpoint = (bounds[i + 1] + bounds[i]) / 2;
 
-		/*
-		 *	Battery current is given by energy conservation
-		 */
-		B->current = (voltageLoad * currentLoad) / B->voltageBattery + B->currentLeak;
+		for (size_t j = 0; j < kGaussLegendreOrder; j++)
+		{
+			double	voltage = socToVoltage(midpoint + halfWidth * kGaussLegendreNodes[j]);
 
-		/*
-		 *	Compute state of charge for battery — it cannot fall below zero.
-		 */
-		B->remainingCapacity -= B->currentOld * (B->timeNow - B->timeOld);
-		B->soc = fmax((B->remainingCapacity / B->totalCapacity), 0);
+			time += kGaussLegendreWeights[j] * halfWidth * voltage / (powerLoad + currentLeak * voltage);
+		}
+	}
 
-		/*
-		 *	Compute battery voltage from discharge characteristic.
-		 */
-		B->voltageBattery = socToVoltage(B->soc);
+	return totalCapacity * time;
+}
 
-		/*
-		 *	Battery terminal voltage has fallen to 'dead' level
-		 */
-		if (B->voltageBattery <= B->voltageBatteryExpended)
+double
+batteryCutoffSoc(const Batt *  B)
+{
+	double	low = 0.0;
+	double	high = 1.0;
+	double	soc;
+
+	/*
+	 *	If the curve never falls to the cutoff voltage, the battery is
+	 *	exhausted at zero state of charge instead.
+	 */
+	if (socToVoltage(low) > B->voltageBatteryExpended)
+	{
+		return low;
+	}
+
+	if (socToVoltage(high) <= B->voltageBatteryExpended)
+	{
+		return high;
+	}
+
+	/*
+	 *	`voltageToSoc` is a close inverse of `socToVoltage`, so it is a good
+	 *	starting point. Newton steps falling outside the bracket are replaced
+	 *	by bisection.
+	 */
+	soc = fmin(fmax(voltageToSoc(B->voltageBatteryExpended) / 100, low), high);
+
+	for (int i = 0; i < kRootFindingMaxIterations; i++)
+	{
+		double	residual = socToVoltage(soc) - B->voltageBatteryExpended;
+		double	step = fmax(soc * kRootFindingTolerance, kRootFindingTolerance);
+		double	slope = (socToVoltage(soc + step) - socToVoltage(soc - step)) / (2 * step);
+		double	next;
+
+		if (fabs(residual) < kRootFindingTolerance)
 		{
-			B->dead = 1;
+			break;
 		}
 
-		B->currentOld = B->current;
-		B->timeOld = B->timeNow;
+		if (residual > 0)
+		{
+			high = soc;
+		}
+		else
+		{
+			low = soc;
+		}
 
+		next = soc - residual / slope;
+		soc = ((next > low) && (next < high)) ? next : (low + high) / 2;
 	}
 
-	return;
+	return soc;
 }
 
-void
-batteryInitialize(Batt *  b, double capacityMilliAh)
+double
+batteryTimeToCutoff(const Batt *  B, double powerLoad)
 {
-	b->timeOld = 0.0;
+	double	socCutoff;
 
-	/*
-	 *	Defaults for generic Li-Ion (Panasonic CGR-17500)
-	 */
-	b->totalCapacity = 3600 * capacityMilliAh / 1000;
-	b->current = 0.0;
-	b->currentOld = 0.0;
-	b->soc = 1.0;
-	b->voltageBattery = 4.2;
-	b->voltageBatteryExpended = 2.0;
-	b->currentLeak = 1E-6;
-
-	b->remainingCapacity = b->totalCapacity;
-	b->dead = 0;
-
-	return;
+	if (B->dead)
+	{
+		return 0.0;
+	}
+
+	socCutoff = batteryCutoffSoc(B);
+
+	return dischargeTime(B->totalCapacity, B->currentLeak, powerLoad, socCutoff, fmax(B->remainingCapacity / B->totalCapacity, socCutoff));
+}
+
+double
+batteryEnergyToCutoff(const Batt *  B, double soc, double socCutoff)
+{
+	return dischargeTime(B->totalCapacity, 0.0, 1.0, socCutoff, fmax(soc, socCutoff));
 }
 
-void
-batterySetSoc(Batt *  B, double soc)
+double
+batteryTimeToCutoffPiecewise(
+	const Batt *		B,
+	const BattLoadSegment *	segments,
+	size_t			numberOfSegments)
 {
-	B->soc = soc;
-	B->remainingCapacity = B->soc * B->totalCapacity;
-	B->voltageBattery = socToVoltage(soc);
+	double	elapsed = 0.0;
+	double	socCutoff;
+	double	soc;
 
-	if (B->voltageBattery <= B->voltageBatteryExpended)
+	if (B->dead)
 	{
-		B->dead = 1;
+		return 0.0;
 	}
 
-	return;
+	socCutoff = batteryCutoffSoc(B);
+	soc = fmax(B->remainingCapacity / B->totalCapacity, socCutoff);
+
+	for (size_t i = 0; i < numberOfSegments; i++)
+	{
+		double	powerLoad = segments[i].powerLoad;
+		double	duration = segments[i].duration;
+		double	remaining = dischargeTime(B->totalCapacity, B->currentLeak, powerLoad, socCutoff, soc);
+		double	low = socCutoff;
+		double	high = soc;
+		double	socEnd;
+		double	voltage;
+
+		if (remaining <= duration)
+		{
+			return elapsed + remaining;
+		}
+
+		/*
+		 *	Solve `dischargeTime(socEnd, soc) == duration` for the state of
+		 *	charge at the end of the segment, starting from a single explicit step.
+		 */
+		voltage = socToVoltage(soc);
+		socEnd = soc - duration * (powerLoad / voltage + B->currentLeak) / B->totalCapacity;
+		socEnd = fmin(fmax(socEnd, low), high);
+
+		for (int j = 0; j < kRootFindingMaxIterations; j++)
+		{
+			double	residual = dischargeTime(B->totalCapacity, B->currentLeak, powerLoad, socEnd, soc) - duration;
+			double	next;
+
+			if (fabs(residual) < kRootFindingTolerance * duration)
+			{
+				break;
+			}
+
+			if (residual > 0)
+			{
+				low = socEnd;
+			}
+			else
+			{
+				high = socEnd;
+			}
+
+			voltage = socToVoltage(socEnd);
+			next = socEnd + residual * (powerLoad + B->currentLeak * voltage) / (B->totalCapacity * voltage);
+			socEnd = ((next > low) && (next < high)) ? next : (low + high) / 2;
+		}
+
+		soc = socEnd;
+		elapsed += duration;
+	}
+
+	return INFINITY;
 }
 
-double
-socToVoltage(double soc)
+/**
+ *	@brief	Load power at a time offset into a load profile.
+ *
+ *	@param	segments		: Load profile.
+ *	@param	numberOfSegments	: Number of entries in `segments`.
+ *	@param	offset			: Time since the start of the profile.
+ *	@param	segmentEnd		: Receives the offset at which the returned power stops applying.
+ *	@return				: Load power (W).
+ */
+static double
+loadProfilePower(
+	const BattLoadSegment *	segments,
+	size_t			numberOfSegments,
+	double			offset,
+	double *		segmentEnd)
 {
-	double voltage;
+	double	start = 0.0;
 
-	/*
-	 *	The following calculations use percentages.
-	 */
-	soc = soc * 100;
+	for (size_t i = 0; i < numberOfSegments; i++)
+	{
+		if (offset < start + segments[i].duration)
+		{
+			*segmentEnd = start + segments[i].duration;
 
-	/*
-	 *	The discharge curve is constructed from a three-segment piecewise function.
-	 */
-	double f1 = kLinearRegionStartVoltage -
-	            (pow((soc - kLinearRegionStartSoc - 1), 2) / kLowerQuadraticScale);
-	double f2 = kLinearRegionM + kLinearRegionK * soc;
-	double f3 = kLinearRegionEndVoltage +
-	            (pow((soc - kLinearRegionEndSoc + 1), 2) / kUpperQuadraticScale);
-	double activation1 = sigmoid(soc, kLinearRegionStartSoc);
-	double activation2 = sigmoid(soc, kLinearRegionEndSoc);
+			return segments[i].powerLoad;
+		}
 
-	/*
-	 *	Assemble components of the piecewise function.
-	 */
-	voltage = f1 + activation1 * (f2 - f1) + activation2 * (f3 - f2);
+		start += segments[i].duration;
+	}
+
+	*segmentEnd = INFINITY;
 
-	return voltage;
+	return 0.0;
 }
 
-/*
- *	V -> SoC characteristic
+/**
+ *	@brief	Rate of change of state of charge under a constant load power.
+ *
+ *	@param	B		: Pointer to battery.
+ *	@param	powerLoad	: Power drawn by the load (W).
+ *	@param	soc		: State of charge.
+ *	@return			: d(soc)/dt (1/s).
  */
-double
-voltageToSoc(double voltage)
+static double
+socDerivative(const Batt *  B, double powerLoad, double soc)
 {
-	double soc;
+	return -(powerLoad / socToVoltage(fmax(soc, 0)) + B->currentLeak) / B->totalCapacity;
+}
 
-	/*
-	 *	The discharge curve is constructed from a three-segment piecewise function.
-	 */
-	double f1 = -pow(kLowerQuadraticScale * fabs(voltage - kLinearRegionStartVoltage), 0.5) +
-	            kLinearRegionStartSoc + 1;
-	double f2 = (voltage - kLinearRegionM) / kLinearRegionK;
-	double f3 = pow(kUpperQuadraticScale * fabs(voltage - kLinearRegionEndVoltage), 0.5) +
-	            kLinearRegionEndSoc - 1;
-	double activation1 = sigmoid(voltage, kLinearRegionStartVoltageMagic);
-	double activation2 = sigmoid(voltage, kLinearRegionEndVoltageMagic);
+CommonConstantReturnType
+batteryIntegrate(
+	Batt *				B,
+	double				timeEnd,
+	const BattLoadSegment *		segments,
+	size_t				numberOfSegments,
+	double				tolerance,
+	BattIntegrationStatistics *	statistics)
+{
+	BattIntegrationStatistics	localStatistics = {0};
+	double				timeStart = B->timeOld;
+	double				time = timeStart;
+	double				soc = B->remainingCapacity / B->totalCapacity;
+	double				socCutoff;
+	double				powerLoad = 0.0;
+	double				step = 0.0;
+
+	if (!(tolerance > 0))
+	{
+		fprintf(stderr, "Error: The integration tolerance must be positive.\n");
+
+		return kCommonConstantReturnTypeError;
+	}
 
 	/*
-	 *	Assemble components of the piecewise function.
+	 *	A cell that already starts at or below its cutoff is latched dead
+	 *	without stepping, so that every step below moves towards the cutoff.
+	 *	As in `batteryUpdate`, only the time of a dead cell advances; the
+	 *	latch is counted once, on the transition.
 	 */
-	soc = f1 + activation1 * (f2 - f1) + activation2 * (f3 - f2);
+	socCutoff = batteryCutoffSoc(B);
+	if (!B->dead && (soc <= socCutoff + tolerance))
+	{
+		COUNTERS_INCREMENT(kCounterBatteryExpendedLatch);
+		B->dead = 1;
+	}
 
-	return soc;
+	if (B->dead)
+	{
+		B->timeNow = timeEnd;
+		if (statistics != NULL)
+		{
+			*statistics = localStatistics;
+		}
+
+		return kCommonConstantReturnTypeSuccess;
+	}
+
+	while ((time < timeEnd) && !B->dead)
+	{
+		double	segmentEnd;
+		double	k1;
+
+		powerLoad = loadProfilePower(segments, numberOfSegments, time - timeStart, &segmentEnd);
+		segmentEnd = fmin(timeStart + segmentEnd, timeEnd);
+		k1 = socDerivative(B, powerLoad, soc);
+
+		/*
+		 *	Initial step: the one whose third-order error term is about `tolerance`.
+		 */
+		if (step == 0.0)
+		{
+			step = cbrt(tolerance) / fmax(fabs(k1), kRootFindingTolerance);
+		}
+
+		while (time < segmentEnd)
+		{
+			double	h = fmin(step, segmentEnd - time);
+			double	k2 = socDerivative(B, powerLoad, soc + h * k1 / 2);
+			double	k3 = socDerivative(B, powerLoad, soc + 3 * h * k2 / 4);
+			double	socNext = soc + h * (2 * k1 / 9 + k2 / 3 + 4 * k3 / 9);
+			double	k4 = socDerivative(B, powerLoad, socNext);
+			double	error = fabs(h * (-5 * k1 / 72 + k2 / 12 + k3 / 9 - k4 / 8));
+			double	scale = kIntegratorSafetyFactor * cbrt(tolerance / fmax(error, DBL_MIN));
+
+			scale = fmin(fmax(scale, kIntegratorMinScale), kIntegratorMaxScale);
+
+			if (error > tolerance)
+			{
+				localStatistics.numberOfRejectedSteps++;
+				step = h * scale;
+
+				continue;
+			}
+
+			/*
+			 *	Shorten a step that overshoots the cutoff so that it lands on it.
+			 *	Since `soc` is above the cutoff, the ratio is in (0, 1); the clamp
+			 *	keeps the step positive and shrinking by a bounded factor.
+			 */
+			if (socNext < socCutoff - tolerance)
+			{
+				localStatistics.numberOfRejectedSteps++;
+				step = h * fmin(fmax((soc - socCutoff) / (soc - socNext), kIntegratorMinScale), 1.0);
+
+				continue;
+			}
+
+			localStatistics.numberOfSteps++;
+			localStatistics.errorEstimate += error;
+			time += h;
+			soc = socNext;
+			k1 = k4;
+			step = h * scale;
+
+			if (soc <= socCutoff + tolerance)
+			{
+				COUNTERS_INCREMENT(kCounterBatteryExpendedLatch);
+				B->dead = 1;
+
+				break;
+			}
+		}
+	}
+
+	B->timeNow = time;
+	B->timeOld = time;
+	B->remainingCapacity = soc * B->totalCapacity;
+	B->soc = fmax(soc, 0);
+	B->voltageBattery = socToVoltage(B->soc);
+	B->current = powerLoad / B->voltageBattery + B->currentLeak;
+	B->currentOld = B->current;
+
+	if (statistics != NULL)
+	{
+		*statistics = localStatistics;
+	}
+
+	return kCommonConstantReturnTypeSuccess;
 }
 
-double
-sigmoid(double x, double start)
+CommonConstantReturnType
+batteryUpdateProfile(
+	Batt *			B,
+	double			timeEnd,
+	const BattLoadSegment *	segments,
+	size_t			numberOfSegments,
+	double			timeStep,
+	size_t *		numberOfSteps)
 {
-	double supportMaxAbs =
-		fmax(fabs(UxHwDoubleSupportMax(x - start)), 
-	             fabs(UxHwDoubleSupportMin(x - start)));
-	double scale = kSigmoidMaxScale / supportMaxAbs;
+	double	timeStart = B->timeOld;
+	size_t	localNumberOfSteps = 0;
+
+	if (!(timeStep > 0))
+	{
+		fprintf(stderr, "Error: The timestep must be positive.\n");
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	while ((B->timeOld < timeEnd) && !B->dead)
+	{
+		double	segmentEnd;
+		double	time = fmin(B->timeOld + timeStep, timeEnd);
+
+		/*
+		 *	`batteryUpdate` takes load current and voltage; a unit load voltage
+		 *	makes the current argument equal to the load power.
+		 */
+		batteryUpdate(
+			B,
+			time,
+			loadProfilePower(segments, numberOfSegments, time - timeStart, &segmentEnd),
+			1.0);
+		localNumberOfSteps++;
+	}
+
+	if (numberOfSteps != NULL)
+	{
+		*numberOfSteps = localNumberOfSteps;
+	}
 
-	return (1 / (1 + exp(-scale * (x - start))));
+	return kCommonConstantReturnTypeSuccess;
 }
@@ -22,6 +22,9 @@
 
 #pragma once
 
+#include <stddef.h>
+#include "common.h"
+
 typedef struct
 {
 	int	dead;
@@ -37,6 +40,25 @@ typedef struct
 	double	remainingCapacity;
 } Batt;
 
+/*
+ *	Discharge characteristic for `batteryUpdateCurve`: the battery voltage at
+ *	the state of charge and current that the update has just computed in `B`.
+ */
+typedef double	(*BattCurve)(const void *  context, const Batt *  B);
+
+typedef struct
+{
+	double	duration;
+	double	powerLoad;
+} BattLoadSegment;
+
+typedef struct
+{
+	size_t	numberOfSteps;
+	size_t	numberOfRejectedSteps;
+	double	errorEstimate;
+} BattIntegrationStatistics;
+
 /**
  *	@brief	Update battery.
  *
@@ -51,6 +73,24 @@ void	batteryUpdate(
 		double	currentLoad,
 		double	voltageLoad);
 
+/**
+ *	@brief	Update battery, with the voltage taken from a caller-supplied discharge characteristic.
+ *
+ *	@param	B		: Pointer to battery.
+ *	@param	timeNow		: Current time.
+ *	@param	currentLoad	: Current at load.
+ *	@param	voltageLoad	: Voltage at load.
+ *	@param	curve		: Discharge characteristic.
+ *	@param	context		: Passed to `curve`.
+ */
+void	batteryUpdateCurve(
+		Batt *		B,
+		double		timeNow,
+		double		currentLoad,
+		double		voltageLoad,
+		BattCurve	curve,
+		const void *	context);
+
 /**
  *	@brief	Initialize a battery to 100% state of charge.
  *
@@ -90,3 +130,114 @@ void	batterySetSoc(Batt *  B, double soc);
  *	@param	start	: Horizontal shift.
  */
 double	sigmoid(double x, double start);
+
+/**
+ *	@brief	Apply `voltageToSoc` to a batch of voltages.
+ *
+ *	@param	voltages		: Input voltages.
+ *	@param	socs			: Receives the states of charge.
+ *	@param	numberOfVoltages	: Number of entries in `voltages` and `socs`.
+ */
+void	voltageToSocBatch(
+		const double *	voltages,
+		double *	socs,
+		size_t		numberOfVoltages);
+
+/**
+ *	@brief	Apply `socToVoltage` to a batch of states of charge.
+ *
+ *	@param	socs		: Input states of charge.
+ *	@param	voltages	: Receives the voltages.
+ *	@param	numberOfSocs	: Number of entries in `socs` and `voltages`.
+ */
+void	socToVoltageBatch(
+		const double *	socs,
+		double *	voltages,
+		size_t		numberOfSocs);
+
+/**
+ *	@brief	State of charge at which the terminal voltage reaches `voltageBatteryExpended`.
+ *
+ *	@param	B	: Pointer to battery.
+ *	@return		: Cutoff state of charge in [0.0 - 1.0].
+ */
+double	batteryCutoffSoc(const Batt *  B);
+
+/**
+ *	@brief	Time until the battery reaches its cutoff voltage under a constant load power.
+ *
+ *	@param	B		: Pointer to battery.
+ *	@param	powerLoad	: Power drawn by the load (W).
+ *	@return			: Time to cutoff (s).
+ */
+double	batteryTimeToCutoff(const Batt *  B, double powerLoad);
+
+/**
+ *	@brief	Energy the battery delivers from a state of charge until it reaches its cutoff voltage.
+ *
+ *		The cutoff state of charge is passed in so that callers evaluating many
+ *		states of charge solve for it once, with `batteryCutoffSoc`.
+ *
+ *	@param	B		: Pointer to battery.
+ *	@param	soc		: State of charge in [0.0 - 1.0].
+ *	@param	socCutoff	: Cutoff state of charge, from `batteryCutoffSoc(B)`.
+ *	@return			: Energy (J).
+ */
+double	batteryEnergyToCutoff(const Batt *  B, double soc, double socCutoff);
+
+/**
+ *	@brief	Time until the battery reaches its cutoff voltage under a piecewise-constant load power.
+ *
+ *	@param	B			: Pointer to battery.
+ *	@param	segments		: Load profile.
+ *	@param	numberOfSegments	: Number of entries in `segments`.
+ *	@return				: Time to cutoff (s), or `INFINITY` if the profile ends first.
+ */
+double	batteryTimeToCutoffPiecewise(
+		const Batt *		B,
+		const BattLoadSegment *	segments,
+		size_t			numberOfSegments);
+
+/**
+ *	@brief	Advance battery to `timeEnd` with adaptive, error-controlled timesteps.
+ *
+ *		The load profile starts at `B->timeOld`; beyond its last segment only
+ *		the leakage current is drawn. Steps never straddle a segment boundary.
+ *		As in `batteryUpdate`, a dead cell is left as it is apart from `timeNow`.
+ *
+ *	@param	B			: Pointer to battery.
+ *	@param	timeEnd			: Time to advance to.
+ *	@param	segments		: Load profile.
+ *	@param	numberOfSegments	: Number of entries in `segments`.
+ *	@param	tolerance		: Per-step tolerance on the state of charge; must be positive.
+ *	@param	statistics		: If not `NULL`, receives step counts and the accumulated error estimate.
+ *	@return				: `kCommonConstantReturnTypeSuccess` if successful, else `kCommonConstantReturnTypeError`.
+ */
+CommonConstantReturnType	batteryIntegrate(
+					Batt *				B,
+					double				timeEnd,
+					const BattLoadSegment *		segments,
+					size_t				numberOfSegments,
+					double				tolerance,
+					BattIntegrationStatistics *	statistics);
+
+/**
+ *	@brief	Advance battery to `timeEnd` with fixed timesteps of `batteryUpdate`.
+ *
+ *		This is the reference against which `batteryIntegrate` is measured.
+ *
+ *	@param	B			: Pointer to battery.
+ *	@param	timeEnd			: Time to advance to.
+ *	@param	segments		: Load profile, starting at `B->timeOld`.
+ *	@param	numberOfSegments	: Number of entries in `segments`.
+ *	@param	timeStep		: Fixed timestep; must be positive.
+ *	@param	numberOfSteps		: If not `NULL`, receives the number of steps taken.
+ *	@return				: `kCommonConstantReturnTypeSuccess` if successful, else `kCommonConstantReturnTypeError`.
+ */
+CommonConstantReturnType	batteryUpdateProfile(
+					Batt *			B,
+					double			timeEnd,
+					const BattLoadSegment *	segments,
+					size_t			numberOfSegments,
+					double			timeStep,
+					size_t *		numberOfSteps);
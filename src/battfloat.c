@@ -0,0 +1,121 @@
+/*
+ *	Copyright (c) 2022–2024, Signaloid.
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in all
+ *	copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *	SOFTWARE.
+ */
+
+
+#include "battfloat.h"
+#include "batt.h"
+#include <uxhw.h>
+
+
+/*
+ *	Single-precision counterpart of `kSigmoidMinSupport`, large enough that
+ *	`kSigmoidMaxScale / kSigmoidMinSupportFloat` stays finite.
+ */
+const float		kSigmoidMinSupportFloat = 1E-30f;
+
+/*
+ *	Entries converted to single precision per pass of the `...AtPrecision` batch
+ *	functions, small enough for the staging buffers to live on the stack.
+ */
+#define	kBattPrecisionChunkSize		(256)
+
+#define	BATT_KERNEL_REAL		float
+#define	BATT_KERNEL_STATE		BattFloat
+#define	BATT_KERNEL_NAME(name)		name##Float
+#define	BATT_KERNEL_SUPPORT_MAX		UxHwFloatSupportMax
+#define	BATT_KERNEL_SUPPORT_MIN		UxHwFloatSupportMin
+#define	BATT_KERNEL_MIN_SUPPORT		kSigmoidMinSupportFloat
+#include "battkernel.inc"
+
+void
+voltageToSocBatchAtPrecision(
+	BattPrecision	precision,
+	const double *	voltages,
+	double *	socs,
+	size_t		numberOfVoltages)
+{
+	float	voltagesFloat[kBattPrecisionChunkSize];
+	float	socsFloat[kBattPrecisionChunkSize];
+
+	if (precision != kBattPrecisionFloat)
+	{
+		voltageToSocBatch(voltages, socs, numberOfVoltages);
+
+		return;
+	}
+
+	for (size_t first = 0; first < numberOfVoltages; first += kBattPrecisionChunkSize)
+	{
+		size_t	count = numberOfVoltages - first < kBattPrecisionChunkSize ? numberOfVoltages - first : kBattPrecisionChunkSize;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			voltagesFloat[i] = (float) voltages[first + i];
+		}
+
+		voltageToSocBatchFloat(voltagesFloat, socsFloat, count);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			socs[first + i] = socsFloat[i];
+		}
+	}
+
+	return;
+}
+
+void
+socToVoltageBatchAtPrecision(
+	BattPrecision	precision,
+	const double *	socs,
+	double *	voltages,
+	size_t		numberOfSocs)
+{
+	float	socsFloat[kBattPrecisionChunkSize];
+	float	voltagesFloat[kBattPrecisionChunkSize];
+
+	if (precision != kBattPrecisionFloat)
+	{
+		socToVoltageBatch(socs, voltages, numberOfSocs);
+
+		return;
+	}
+
+	for (size_t first = 0; first < numberOfSocs; first += kBattPrecisionChunkSize)
+	{
+		size_t	count = numberOfSocs - first < kBattPrecisionChunkSize ? numberOfSocs - first : kBattPrecisionChunkSize;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			socsFloat[i] = (float) socs[first + i];
+		}
+
+		socToVoltageBatchFloat(socsFloat, voltagesFloat, count);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			voltages[first + i] = voltagesFloat[i];
+		}
+	}
+
+	return;
+}
@@ -0,0 +1,554 @@
+/*
+ *	Copyright (c) 2022–2024, Signaloid.
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in all
+ *	copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *	SOFTWARE.
+ */
+
+
+#include "benchmark.h"
+#include "batt.h"
+#include "checkpoint.h"
+#include "common.h"
+#include "counters.h"
+#include "noise.h"
+#include "route.h"
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <uxhw.h>
+
+
+#define	kBenchmarkNoiseWindowSize		(64)
+#define	kBenchmarkNoiseTicks			(100)
+#define	kBenchmarkNoiseDistinctTicks		(8)
+#define	kBenchmarkNoiseMaxCells			(1000000)
+
+#define	kBenchmarkIntegratorTolerance		(1E-6)
+#define	kBenchmarkIntegratorReferenceTimeStep	(1E-3)
+#define	kBenchmarkIntegratorDuration		(3600.0)
+
+#define	kBenchmarkRoutes			(10000)
+#define	kBenchmarkRouteSocSamples		(1000)
+#define	kBenchmarkRouteRepeats			(10)
+
+#define	kBenchmarkCheckpointFileTemplate	"fleet-checkpoint.XXXXXX"
+#define	kBenchmarkCheckpointDefaultDirectory	"/tmp"
+#define	kBenchmarkCheckpointDirtyFraction	(0.01)
+
+#define	kBenchmarkCountersMaxCells		(10000)
+#define	kBenchmarkCountersTicks			(10)
+#define	kBenchmarkCountersRepeats		(50)
+
+const double	kBenchmarkVoltageMean = 3.7;
+const double	kBenchmarkVoltageStandardDeviation = 0.01;
+
+/*
+ *	Copies of `batteryUpdate` and `voltageToSoc` compiled from `battkernel.inc`
+ *	with the counters compiled out, at the end of this file, so that only the
+ *	fleet benchmark carries them. They are not inlined, so that they are called
+ *	like the instrumented kernels in `batt.c`.
+ */
+void	batteryUpdateUninstrumented(Batt *  B, double timeNow, double currentLoad, double voltageLoad) __attribute__((noinline));
+double	voltageToSocUninstrumented(double voltage) __attribute__((noinline));
+
+/**
+ *	@brief	Time sliding-window noise estimation: every cell receives one reading per tick.
+ *
+ *		The windows take about 1 kB per cell, so at most `kBenchmarkNoiseMaxCells`
+ *		cells are used; the per-reading cost is flat beyond a few times the cache size.
+ *
+ *	@param	numberOfCells	: Number of cells in the fleet.
+ *	@param	stream		: Output stream.
+ *	@return			: `kCommonConstantReturnTypeSuccess` if successful, else `kCommonConstantReturnTypeError`.
+ */
+static CommonConstantReturnType
+benchmarkNoiseWindows(size_t numberOfCells, FILE *  stream)
+{
+	NoiseWindows	windows;
+	double *	readings;
+	clock_t		start;
+	double		cpuTimeUsedInSeconds;
+
+	numberOfCells = (numberOfCells < kBenchmarkNoiseMaxCells) ? numberOfCells : kBenchmarkNoiseMaxCells;
+
+	/*
+	 *	Readings are drawn up front so that only the window updates are timed.
+	 */
+	readings = (double *) checkedMalloc(kBenchmarkNoiseDistinctTicks * numberOfCells * sizeof(double), __FILE__, __LINE__);
+	for (size_t i = 0; i < kBenchmarkNoiseDistinctTicks * numberOfCells; i++)
+	{
+		readings[i] = UxHwDoubleGaussDist(kBenchmarkVoltageMean, kBenchmarkVoltageStandardDeviation);
+	}
+
+	if (noiseWindowsInitialize(&windows, numberOfCells, kBenchmarkNoiseWindowSize) != kCommonConstantReturnTypeSuccess)
+	{
+		free(readings);
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	start = clock();
+	for (size_t tick = 0; tick < kBenchmarkNoiseTicks; tick++)
+	{
+		noiseWindowsUpdateAll(&windows, &readings[(tick % kBenchmarkNoiseDistinctTicks) * numberOfCells]);
+	}
+	cpuTimeUsedInSeconds = ((double) (clock() - start)) / CLOCKS_PER_SEC;
+
+	fprintf(
+		stream,
+		"Noise window update (window %d): %zu cells x %d readings in %lf s, %.2lf ns/reading\n",
+		kBenchmarkNoiseWindowSize,
+		numberOfCells,
+		kBenchmarkNoiseTicks,
+		cpuTimeUsedInSeconds,
+		1E9 * cpuTimeUsedInSeconds / ((double) numberOfCells * kBenchmarkNoiseTicks));
+
+	noiseWindowsFree(&windows);
+	free(readings);
+
+	return kCommonConstantReturnTypeSuccess;
+}
+
+static double
+monotonicSeconds(void)
+{
+	struct timespec	now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + now.tv_nsec / 1E9;
+}
+
+/**
+ *	@brief	Compare `batteryIntegrate` against a fine fixed-step `batteryUpdateProfile` run over one flight.
+ *
+ *	@param	stream	: Output stream.
+ *	@return		: `kCommonConstantReturnTypeSuccess` if successful, else `kCommonConstantReturnTypeError`.
+ */
+static CommonConstantReturnType
+benchmarkIntegrator(FILE *  stream)
+{
+	/*
+	 *	Take-off, cruise and a heavier return leg, then leakage only.
+	 */
+	BattLoadSegment			profile[] = {{120.0, 8.0}, {1200.0, 4.0}, {600.0, 6.0}};
+	size_t				numberOfSegments = sizeof(profile) / sizeof(profile[0]);
+	BattIntegrationStatistics	statistics;
+	Batt				adaptive;
+	Batt				reference;
+	size_t				numberOfReferenceSteps;
+	double				start;
+	double				adaptiveSeconds;
+	double				referenceSeconds;
+
+	batteryInitialize(&adaptive, 800);
+	batteryInitialize(&reference, 800);
+
+	start = monotonicSeconds();
+	if (batteryIntegrate(
+			&adaptive,
+			kBenchmarkIntegratorDuration,
+			profile,
+			numberOfSegments,
+			kBenchmarkIntegratorTolerance,
+			&statistics) != kCommonConstantReturnTypeSuccess)
+	{
+		return kCommonConstantReturnTypeError;
+	}
+	adaptiveSeconds = monotonicSeconds() - start;
+
+	start = monotonicSeconds();
+	if (batteryUpdateProfile(
+			&reference,
+			kBenchmarkIntegratorDuration,
+			profile,
+			numberOfSegments,
+			kBenchmarkIntegratorReferenceTimeStep,
+			&numberOfReferenceSteps) != kCommonConstantReturnTypeSuccess)
+	{
+		return kCommonConstantReturnTypeError;
+	}
+	referenceSeconds = monotonicSeconds() - start;
+
+	fprintf(stream, "Adaptive integration over %.0lf s (tolerance %g):\n", kBenchmarkIntegratorDuration, kBenchmarkIntegratorTolerance);
+	fprintf(
+		stream,
+		"\tadaptive: %zu steps (%zu rejected) in %lf s, state of charge %lf, error estimate %g\n",
+		statistics.numberOfSteps,
+		statistics.numberOfRejectedSteps,
+		adaptiveSeconds,
+		adaptive.soc,
+		statistics.errorEstimate);
+	fprintf(
+		stream,
+		"\treference (%g s steps): %zu steps in %lf s, state of charge %lf\n",
+		kBenchmarkIntegratorReferenceTimeStep,
+		numberOfReferenceSteps,
+		referenceSeconds,
+		reference.soc);
+	fprintf(stream, "\terror against reference: %g\n", fabs(adaptive.soc - reference.soc));
+
+	return kCommonConstantReturnTypeSuccess;
+}
+
+/**
+ *	@brief	Time ranking a batch of candidate return-to-home routes for one drone.
+ *
+ *	@param	stream	: Output stream.
+ */
+static void
+benchmarkRoutes(FILE *  stream)
+{
+	Batt		B;
+	Route *		routes = (Route *) checkedMalloc(kBenchmarkRoutes * sizeof(Route), __FILE__, __LINE__);
+	double *	socSamples = (double *) checkedMalloc(kBenchmarkRouteSocSamples * sizeof(double), __FILE__, __LINE__);
+	double		start;
+	double		fastestSeconds = INFINITY;
+
+	batteryInitialize(&B, 800);
+	for (size_t i = 0; i < kBenchmarkRouteSocSamples; i++)
+	{
+		socSamples[i] = voltageToSoc(UxHwDoubleGaussDist(kBenchmarkVoltageMean, kBenchmarkVoltageStandardDeviation)) / 100;
+	}
+
+	for (size_t repeat = 0; repeat < kBenchmarkRouteRepeats; repeat++)
+	{
+		/*
+		 *	Route costs spread around the energy left at the mean state of charge.
+		 */
+		for (size_t i = 0; i < kBenchmarkRoutes; i++)
+		{
+			routes[i].index = i;
+			routes[i].energyMean = 2000.0 + 6000.0 * i / kBenchmarkRoutes;
+			routes[i].energyStandardDeviation = 0.1 * routes[i].energyMean;
+		}
+
+		start = monotonicSeconds();
+		routesRankByProbabilityOfReachingHome(&B, socSamples, kBenchmarkRouteSocSamples, routes, kBenchmarkRoutes);
+		fastestSeconds = fmin(fastestSeconds, monotonicSeconds() - start);
+	}
+
+	fprintf(
+		stream,
+		"Route ranking: %d routes, %d state of charge samples in %.3lf ms (best route %zu, P = %lf)\n",
+		kBenchmarkRoutes,
+		kBenchmarkRouteSocSamples,
+		1E3 * fastestSeconds,
+		routes[0].index,
+		routes[0].probabilityOfReachingHome);
+
+	free(routes);
+	free(socSamples);
+
+	return;
+}
+
+/**
+ *	@brief	Time a full and an incremental checkpoint of the fleet, and restoring it.
+ *
+ *	@param	numberOfCells	: Number of cells in the fleet.
+ *	@param	stream		: Output stream.
+ *	@return			: `kCommonConstantReturnTypeSuccess` if successful, else `kCommonConstantReturnTypeError`.
+ */
+static CommonConstantReturnType
+benchmarkCheckpoint(size_t numberOfCells, FILE *  stream)
+{
+	Checkpoint	checkpoint;
+	CheckpointView	view;
+	Batt *		cells;
+	size_t		numberOfDirtyCells = (size_t) (numberOfCells * kBenchmarkCheckpointDirtyFraction);
+	size_t		numberOfBlocksWritten;
+	double		start;
+	double		fullWriteSeconds;
+	double		incrementalWriteSeconds;
+	double		restoreSeconds;
+	double		firstPassSeconds;
+	double		socSum = 0.0;
+	const char *	directory = getenv("TMPDIR");
+	char		path[PATH_MAX];
+	int		fileDescriptor;
+
+	/*
+	 *	The checkpoint goes to a new file under `$TMPDIR`, which `checkpointOpen`
+	 *	sizes since it is empty, and is removed when the benchmark ends.
+	 */
+	if ((directory == NULL) || (directory[0] == '\0'))
+	{
+		directory = kBenchmarkCheckpointDefaultDirectory;
+	}
+
+	if (snprintf(path, sizeof(path), "%s/%s", directory, kBenchmarkCheckpointFileTemplate) >= (int) sizeof(path))
+	{
+		fprintf(stderr, "Error: Temporary directory path \"%s\" is too long.\n", directory);
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	fileDescriptor = mkstemp(path);
+	if (fileDescriptor < 0)
+	{
+		fprintf(stderr, "Error: Could not create a checkpoint file in \"%s\".\n", directory);
+
+		return kCommonConstantReturnTypeError;
+	}
+	close(fileDescriptor);
+
+	cells = (Batt *) checkedMalloc(numberOfCells * sizeof(Batt), __FILE__, __LINE__);
+	for (size_t i = 0; i < numberOfCells; i++)
+	{
+		batteryInitialize(&cells[i], 800);
+	}
+
+	if (checkpointOpen(&checkpoint, path, numberOfCells) != kCommonConstantReturnTypeSuccess)
+	{
+		free(cells);
+		unlink(path);
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	checkpointMarkAllDirty(&checkpoint);
+	start = monotonicSeconds();
+	if (checkpointWrite(&checkpoint, cells, false, NULL) != kCommonConstantReturnTypeSuccess)
+	{
+		checkpointClose(&checkpoint);
+		free(cells);
+		unlink(path);
+
+		return kCommonConstantReturnTypeError;
+	}
+	fullWriteSeconds = monotonicSeconds() - start;
+
+	/*
+	 *	Advance the cells that reported telemetry since the last periodic
+	 *	checkpoint. The first round still copies every block into the second
+	 *	image; the second round is timed as the steady state.
+	 */
+	for (size_t round = 0; round < 2; round++)
+	{
+		for (size_t i = 0; i < numberOfDirtyCells; i++)
+		{
+			batteryUpdate(&cells[i], 1.0 + round, 1.0, 1.0);
+			checkpointMarkDirty(&checkpoint, i);
+		}
+
+		start = monotonicSeconds();
+		if (checkpointWrite(&checkpoint, cells, false, &numberOfBlocksWritten) != kCommonConstantReturnTypeSuccess)
+		{
+			checkpointClose(&checkpoint);
+			free(cells);
+			unlink(path);
+
+			return kCommonConstantReturnTypeError;
+		}
+		incrementalWriteSeconds = monotonicSeconds() - start;
+	}
+	checkpointClose(&checkpoint);
+
+	start = monotonicSeconds();
+	if (checkpointRestore(&view, path) != kCommonConstantReturnTypeSuccess)
+	{
+		free(cells);
+		unlink(path);
+
+		return kCommonConstantReturnTypeError;
+	}
+	restoreSeconds = monotonicSeconds() - start;
+
+	start = monotonicSeconds();
+	for (size_t i = 0; i < view.numberOfCells; i++)
+	{
+		socSum += view.cells[i].soc;
+	}
+	firstPassSeconds = monotonicSeconds() - start;
+
+	fprintf(stream, "Checkpoint of %zu cells (%zu bytes each):\n", numberOfCells, sizeof(Batt));
+	fprintf(stream, "\tfull write: %lf s\n", fullWriteSeconds);
+	fprintf(stream, "\tincremental write (%zu dirty blocks): %lf s\n", numberOfBlocksWritten, incrementalWriteSeconds);
+	fprintf(stream, "\trestore (map): %lf s\n", restoreSeconds);
+	fprintf(stream, "\tfirst pass over restored cells: %lf s (mean state of charge %lf)\n", firstPassSeconds, socSum / numberOfCells);
+
+	checkpointRelease(&view);
+	unlink(path);
+	free(cells);
+
+	return kCommonConstantReturnTypeSuccess;
+}
+
+/**
+ *	@brief	Run one repeat of the counters benchmark.
+ *
+ *		Every cell is updated and its state of charge re-estimated from its
+ *		voltage once per tick.
+ *
+ *	@param	cells		: Cells.
+ *	@param	numberOfCells	: Number of cells.
+ *	@param	isInstrumented	: Whether to run `batt.c` or the uninstrumented copies below.
+ *	@param	socSum		: Accumulates the estimated states of charge.
+ *	@return			: Time taken (s).
+ */
+static double
+benchmarkCountersRepeat(Batt *  cells, size_t numberOfCells, bool isInstrumented, double *  socSum)
+{
+	double	start;
+
+	for (size_t i = 0; i < numberOfCells; i++)
+	{
+		batteryInitialize(&cells[i], 800);
+	}
+
+	start = monotonicSeconds();
+	for (size_t tick = 1; tick <= kBenchmarkCountersTicks; tick++)
+	{
+		for (size_t i = 0; i < numberOfCells; i++)
+		{
+			if (isInstrumented)
+			{
+				batteryUpdate(&cells[i], (double) tick, 0.1, 1.0);
+				*socSum += voltageToSoc(cells[i].voltageBattery);
+			}
+			else
+			{
+				batteryUpdateUninstrumented(&cells[i], (double) tick, 0.1, 1.0);
+				*socSum += voltageToSocUninstrumented(cells[i].voltageBattery);
+			}
+		}
+	}
+
+	return monotonicSeconds() - start;
+}
+
+/**
+ *	@brief	Measure the overhead of the counters.
+ *
+ *		Times the instrumented kernels against their uninstrumented copies,
+ *		which are compiled from the same source with the same flags, so one
+ *		run gives the overhead of the counters in the current build. The two
+ *		alternate across repeats so that both see the same machine state,
+ *		the cells fit in cache so that the kernels, not memory bandwidth,
+ *		dominate, and the fastest repeat of each is reported to suppress
+ *		scheduling noise. In a build without counters the two are the same
+ *		code, and their difference is the noise floor of the measurement.
+ *
+ *	@param	numberOfCells	: Number of cells in the fleet.
+ *	@param	stream		: Output stream.
+ */
+static void
+benchmarkCounters(size_t numberOfCells, FILE *  stream)
+{
+#if defined(BATT_ENABLE_COUNTER_TIMERS)
+	const char *	build = "counters and timers";
+#elif defined(BATT_ENABLE_COUNTERS)
+	const char *	build = "counters";
+#else
+	const char *	build = "compiled out";
+#endif
+	Batt *		cells;
+	double		fastestSeconds = INFINITY;
+	double		fastestUninstrumentedSeconds = INFINITY;
+	double		socSum = 0.0;
+	double		updatesPerRepeat;
+
+	numberOfCells = (numberOfCells < kBenchmarkCountersMaxCells) ? numberOfCells : kBenchmarkCountersMaxCells;
+	updatesPerRepeat = (double) numberOfCells * kBenchmarkCountersTicks;
+	cells = (Batt *) checkedMalloc(numberOfCells * sizeof(Batt), __FILE__, __LINE__);
+
+	for (size_t repeat = 0; repeat < kBenchmarkCountersRepeats; repeat++)
+	{
+		fastestSeconds = fmin(fastestSeconds, benchmarkCountersRepeat(cells, numberOfCells, true, &socSum));
+		fastestUninstrumentedSeconds = fmin(
+							fastestUninstrumentedSeconds,
+							benchmarkCountersRepeat(cells, numberOfCells, false, &socSum));
+	}
+
+	fprintf(
+		stream,
+		"Instrumented kernels (%s): %zu cells x %d updates, %.2lf ns/update, uninstrumented %.2lf ns/update, overhead %+.2lf%% (mean state of charge %lf)\n",
+		build,
+		numberOfCells,
+		kBenchmarkCountersTicks,
+		1E9 * fastestSeconds / updatesPerRepeat,
+		1E9 * fastestUninstrumentedSeconds / updatesPerRepeat,
+		100 * (fastestSeconds / fastestUninstrumentedSeconds - 1),
+		socSum / (2 * updatesPerRepeat * kBenchmarkCountersRepeats));
+
+	free(cells);
+
+	return;
+}
+
+CommonConstantReturnType
+benchmarkFleet(size_t numberOfCells, FILE *  stream)
+{
+	if (numberOfCells == 0)
+	{
+		fprintf(stderr, "Error: The fleet benchmark needs at least one cell.\n");
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	if (benchmarkIntegrator(stream) != kCommonConstantReturnTypeSuccess)
+	{
+		return kCommonConstantReturnTypeError;
+	}
+
+	benchmarkRoutes(stream);
+	if (benchmarkNoiseWindows(numberOfCells, stream) != kCommonConstantReturnTypeSuccess)
+	{
+		return kCommonConstantReturnTypeError;
+	}
+
+	benchmarkCounters(numberOfCells, stream);
+
+	return benchmarkCheckpoint(numberOfCells, stream);
+}
+
+/*
+ *	The uninstrumented kernels. They are included last so that <tgmath.h>,
+ *	which the kernel source includes, does not apply to the code above.
+ */
+extern const double	kSigmoidMinSupport;
+
+typedef BattCurve	BattCurveUninstrumented;
+double	socToVoltageUninstrumented(double soc);
+double	sigmoidUninstrumented(double x, double start);
+
+#undef	COUNTERS_BLOCK
+#undef	COUNTERS_INCREMENT_BLOCK
+#undef	COUNTERS_INCREMENT
+#undef	COUNTERS_TIMER_START
+#undef	COUNTERS_TIMER_LAP
+#undef	COUNTERS_TIMER_STOP
+#define	COUNTERS_BLOCK()				((CountersBlock *) NULL)
+#define	COUNTERS_INCREMENT_BLOCK(block, counter)	do { (void) (block); (void) (counter); } while (0)
+#define	COUNTERS_INCREMENT(counter)			do {} while (0)
+#define	COUNTERS_TIMER_START(name)		do {} while (0)
+#define	COUNTERS_TIMER_LAP(timer, name)		do {} while (0)
+#define	COUNTERS_TIMER_STOP(timer, name)	do {} while (0)
+
+#define	BATT_KERNEL_REAL		double
+#define	BATT_KERNEL_STATE		Batt
+#define	BATT_KERNEL_NAME(name)		name##Uninstrumented
+#define	BATT_KERNEL_SUPPORT_MAX		UxHwDoubleSupportMax
+#define	BATT_KERNEL_SUPPORT_MIN		UxHwDoubleSupportMin
+#define	BATT_KERNEL_MIN_SUPPORT		kSigmoidMinSupport
+#include "battkernel.inc"
@@ -0,0 +1,359 @@
+/*
+ *	Copyright (c) 2022–2024, Signaloid.
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in all
+ *	copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *	SOFTWARE.
+ */
+
+
+#include "checkpoint.h"
+#include "common.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+#define	kCheckpointVersion		(2)
+#define	kCheckpointHeaderSize		(4096)
+#define	kCheckpointCellsPerBlock	(512)
+
+/*
+ *	Per-block flags: changed since the last write, and copied into the other
+ *	image by the last write.
+ */
+#define	kCheckpointBlockDirty		(1 << 0)
+#define	kCheckpointBlockStale		(1 << 1)
+
+static const char	kCheckpointMagic[8] = "BATTCKPT";
+
+/**
+ *	@brief	Distance between the two images, rounded up to whole header-size pages so that each can be synced alone.
+ *
+ *	@param	numberOfCells	: Number of cells in the fleet.
+ *	@return			: Image stride (bytes).
+ */
+static size_t
+checkpointImageStride(size_t numberOfCells)
+{
+	return (numberOfCells * sizeof(Batt) + kCheckpointHeaderSize - 1) / kCheckpointHeaderSize * kCheckpointHeaderSize;
+}
+
+static size_t
+checkpointFileSize(size_t numberOfCells)
+{
+	return kCheckpointHeaderSize + kCheckpointNumberOfImages * checkpointImageStride(numberOfCells);
+}
+
+/**
+ *	@brief	Check that a header describes a checkpoint written by this build.
+ *
+ *	@param	header		: Pointer to header.
+ *	@param	fileSize	: Size of the checkpoint file.
+ *	@return			: `true` if the checkpoint can be used.
+ */
+static bool
+checkpointHeaderIsValid(const CheckpointHeader *  header, size_t fileSize)
+{
+	return (memcmp(header->magic, kCheckpointMagic, sizeof(kCheckpointMagic)) == 0) &&
+		(header->version == kCheckpointVersion) &&
+		(header->recordSize == sizeof(Batt)) &&
+		(header->activeImage < kCheckpointNumberOfImages) &&
+		(fileSize == checkpointFileSize(header->numberOfCells));
+}
+
+/**
+ *	@brief	`msync` a byte range of the checkpoint mapping, widened to whole pages.
+ *
+ *	@param	C		: Pointer to checkpoint.
+ *	@param	start		: First byte of the range.
+ *	@param	size		: Size of the range.
+ *	@param	isDurable	: Wait for the range to reach storage (`MS_SYNC`).
+ *	@return			: `kCommonConstantReturnTypeSuccess` if successful, else `kCommonConstantReturnTypeError`.
+ */
+static CommonConstantReturnType
+checkpointSync(Checkpoint *  C, const void *  start, size_t size, bool isDurable)
+{
+	size_t	pageSize = (size_t) sysconf(_SC_PAGESIZE);
+	size_t	offset = (size_t) ((const char *) start - (const char *) C->header);
+	size_t	alignedOffset = offset / pageSize * pageSize;
+
+	if (msync((char *) C->header + alignedOffset, size + offset - alignedOffset, isDurable ? MS_SYNC : MS_ASYNC) != 0)
+	{
+		fprintf(stderr, "Error: Could not write back checkpoint.\n");
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	return kCommonConstantReturnTypeSuccess;
+}
+
+CommonConstantReturnType
+checkpointOpen(Checkpoint *  C, const char *  path, size_t numberOfCells)
+{
+	struct stat	status;
+	size_t		fileSize = checkpointFileSize(numberOfCells);
+
+	C->fileDescriptor = open(path, O_RDWR | O_CREAT, 0644);
+	if (C->fileDescriptor < 0)
+	{
+		fprintf(stderr, "Error: Could not open checkpoint file \"%s\".\n", path);
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	if (fstat(C->fileDescriptor, &status) != 0)
+	{
+		fprintf(stderr, "Error: Could not read the size of checkpoint file \"%s\".\n", path);
+		close(C->fileDescriptor);
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	/*
+	 *	Only an empty (newly created) file is sized. A file of any other size
+	 *	is a checkpoint for a different fleet or not a checkpoint at all, and
+	 *	is left as it is.
+	 */
+	if (status.st_size == 0)
+	{
+		if (ftruncate(C->fileDescriptor, fileSize) != 0)
+		{
+			fprintf(stderr, "Error: Could not size checkpoint file \"%s\" for %zu cells.\n", path, numberOfCells);
+			close(C->fileDescriptor);
+
+			return kCommonConstantReturnTypeError;
+		}
+	}
+	else if ((size_t) status.st_size != fileSize)
+	{
+		fprintf(stderr, "Error: Checkpoint file \"%s\" is not sized for %zu cells.\n", path, numberOfCells);
+		close(C->fileDescriptor);
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	C->header = (CheckpointHeader *) mmap(NULL, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, C->fileDescriptor, 0);
+	if (C->header == MAP_FAILED)
+	{
+		fprintf(stderr, "Error: Could not map checkpoint file \"%s\".\n", path);
+		close(C->fileDescriptor);
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	C->mappingSize = fileSize;
+	C->imageStride = checkpointImageStride(numberOfCells);
+	for (size_t i = 0; i < kCheckpointNumberOfImages; i++)
+	{
+		C->images[i] = (Batt *) ((char *) C->header + kCheckpointHeaderSize + i * C->imageStride);
+	}
+	C->numberOfCells = numberOfCells;
+	C->numberOfBlocks = (numberOfCells + kCheckpointCellsPerBlock - 1) / kCheckpointCellsPerBlock;
+	C->blockFlags = (uint8_t *) checkedMalloc(C->numberOfBlocks, __FILE__, __LINE__);
+
+	/*
+	 *	A file that is not a usable checkpoint for this fleet starts over, with
+	 *	every block dirty. Otherwise its active image is current and only cells
+	 *	changed from now on need writing, but the inactive image holds an older
+	 *	generation of unknown age, so every block is stale in it.
+	 */
+	if (checkpointHeaderIsValid(C->header, fileSize) && C->header->isComplete)
+	{
+		memset(C->blockFlags, kCheckpointBlockStale, C->numberOfBlocks);
+	}
+	else
+	{
+		memcpy(C->header->magic, kCheckpointMagic, sizeof(kCheckpointMagic));
+		C->header->version = kCheckpointVersion;
+		C->header->recordSize = sizeof(Batt);
+		C->header->numberOfCells = numberOfCells;
+		C->header->generation = 0;
+		C->header->isComplete = 0;
+		C->header->activeImage = 0;
+		checkpointMarkAllDirty(C);
+	}
+
+	return kCommonConstantReturnTypeSuccess;
+}
+
+void
+checkpointMarkDirty(Checkpoint *  C, size_t cell)
+{
+	C->blockFlags[cell / kCheckpointCellsPerBlock] |= kCheckpointBlockDirty;
+
+	return;
+}
+
+void
+checkpointMarkAllDirty(Checkpoint *  C)
+{
+	memset(C->blockFlags, kCheckpointBlockDirty | kCheckpointBlockStale, C->numberOfBlocks);
+
+	return;
+}
+
+CommonConstantReturnType
+checkpointWrite(
+	Checkpoint *	C,
+	const Batt *	cells,
+	bool		isDurable,
+	size_t *	numberOfBlocksWritten)
+{
+	uint32_t	image = C->header->isComplete ? 1 - C->header->activeImage : C->header->activeImage;
+	Batt *		target = C->images[image];
+	size_t		localNumberOfBlocksWritten = 0;
+	size_t		firstCellWritten = C->numberOfCells;
+	size_t		lastCellWritten = 0;
+
+	/*
+	 *	The target image is not referenced by the header, so a crash during
+	 *	the copy leaves the active image intact.
+	 */
+	for (size_t block = 0; block < C->numberOfBlocks; block++)
+	{
+		size_t	first;
+		size_t	count;
+
+		if (C->blockFlags[block] == 0)
+		{
+			continue;
+		}
+
+		first = block * kCheckpointCellsPerBlock;
+		count = (first + kCheckpointCellsPerBlock <= C->numberOfCells) ? kCheckpointCellsPerBlock : C->numberOfCells - first;
+
+		memcpy(&target[first], &cells[first], count * sizeof(Batt));
+		localNumberOfBlocksWritten++;
+
+		if (firstCellWritten == C->numberOfCells)
+		{
+			firstCellWritten = first;
+		}
+		lastCellWritten = first + count;
+	}
+
+	/*
+	 *	The image must reach storage before the header that publishes it, and
+	 *	the header stores must not be reordered before the copy. Only the pages
+	 *	spanning the blocks copied above are synced.
+	 */
+	if ((localNumberOfBlocksWritten > 0) &&
+		(checkpointSync(C, &target[firstCellWritten], (lastCellWritten - firstCellWritten) * sizeof(Batt), isDurable) != kCommonConstantReturnTypeSuccess))
+	{
+		return kCommonConstantReturnTypeError;
+	}
+
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	C->header->generation++;
+	C->header->activeImage = image;
+	C->header->isComplete = 1;
+
+	if (checkpointSync(C, C->header, kCheckpointHeaderSize, isDurable) != kCommonConstantReturnTypeSuccess)
+	{
+		return kCommonConstantReturnTypeError;
+	}
+
+	/*
+	 *	Blocks changed since the last write are now stale in the other image.
+	 */
+	for (size_t block = 0; block < C->numberOfBlocks; block++)
+	{
+		C->blockFlags[block] = (C->blockFlags[block] & kCheckpointBlockDirty) ? kCheckpointBlockStale : 0;
+	}
+
+	if (numberOfBlocksWritten != NULL)
+	{
+		*numberOfBlocksWritten = localNumberOfBlocksWritten;
+	}
+
+	return kCommonConstantReturnTypeSuccess;
+}
+
+void
+checkpointClose(Checkpoint *  C)
+{
+	munmap(C->header, C->mappingSize);
+	close(C->fileDescriptor);
+	free(C->blockFlags);
+
+	return;
+}
+
+CommonConstantReturnType
+checkpointRestore(CheckpointView *  V, const char *  path)
+{
+	struct stat			status;
+	const CheckpointHeader *	header;
+	int				fileDescriptor = open(path, O_RDONLY);
+
+	if (fileDescriptor < 0)
+	{
+		fprintf(stderr, "Error: Could not open checkpoint file \"%s\".\n", path);
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	if ((fstat(fileDescriptor, &status) != 0) || ((size_t) status.st_size < kCheckpointHeaderSize))
+	{
+		fprintf(stderr, "Error: Checkpoint file \"%s\" is truncated.\n", path);
+		close(fileDescriptor);
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	/*
+	 *	A private mapping is copy-on-write: cells are paged in on first access
+	 *	and updating them never modifies the file.
+	 */
+	V->mappingSize = status.st_size;
+	V->mapping = mmap(NULL, V->mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileDescriptor, 0);
+	close(fileDescriptor);
+	if (V->mapping == MAP_FAILED)
+	{
+		fprintf(stderr, "Error: Could not map checkpoint file \"%s\".\n", path);
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	header = (const CheckpointHeader *) V->mapping;
+	if (!checkpointHeaderIsValid(header, V->mappingSize) || !header->isComplete)
+	{
+		fprintf(stderr, "Error: \"%s\" is not a complete checkpoint written by this version.\n", path);
+		munmap(V->mapping, V->mappingSize);
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	V->cells = (Batt *) ((char *) V->mapping + kCheckpointHeaderSize + header->activeImage * checkpointImageStride(header->numberOfCells));
+	V->numberOfCells = header->numberOfCells;
+	V->generation = header->generation;
+
+	return kCommonConstantReturnTypeSuccess;
+}
+
+void
+checkpointRelease(CheckpointView *  V)
+{
+	munmap(V->mapping, V->mappingSize);
+
+	return;
+}
@@ -0,0 +1,155 @@
+/*
+ *	Copyright (c) 2022-2024, Signaloid.
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in all
+ *	copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *	SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "batt.h"
+#include "common.h"
+
+/*
+ *	A checkpoint file is a one-page header followed by two images of the `Batt`
+ *	state of every cell, in memory layout. Writes alternate between the images
+ *	and `activeImage` is switched only once the new image is complete, so a
+ *	crash part-way through a write leaves the previous checkpoint restorable.
+ *	Restoring maps the file; nothing is parsed.
+ */
+typedef struct
+{
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	recordSize;
+	uint64_t	numberOfCells;
+	uint64_t	generation;
+	uint32_t	isComplete;
+	uint32_t	activeImage;
+} CheckpointHeader;
+
+#define	kCheckpointNumberOfImages	(2)
+
+/*
+ *	Writer side: the checkpoint file mapped shared, plus per-block flags. A
+ *	block is copied if it was marked dirty since the last write, or if it was
+ *	copied into the other image by the last write and so is stale in this one.
+ */
+typedef struct
+{
+	int			fileDescriptor;
+	size_t			mappingSize;
+	size_t			imageStride;
+	CheckpointHeader *	header;
+	Batt *			images[kCheckpointNumberOfImages];
+	size_t			numberOfCells;
+	size_t			numberOfBlocks;
+	uint8_t *		blockFlags;
+} Checkpoint;
+
+/*
+ *	Reader side: a private (copy-on-write) mapping of a checkpoint file. `cells`
+ *	points into its active image and can be used directly as the live fleet state.
+ */
+typedef struct
+{
+	void *		mapping;
+	size_t		mappingSize;
+	Batt *		cells;
+	size_t		numberOfCells;
+	uint64_t	generation;
+} CheckpointView;
+
+/**
+ *	@brief	Open (creating if needed) a checkpoint file for writing.
+ *
+ *		An existing checkpoint for the same number of cells is kept, so a
+ *		process can restore from a file and then keep checkpointing into it.
+ *		An existing non-empty file whose size does not match `numberOfCells`
+ *		is refused and left untouched.
+ *
+ *	@param	C		: Pointer to checkpoint.
+ *	@param	path		: Path to the checkpoint file.
+ *	@param	numberOfCells	: Number of cells in the fleet.
+ *	@return			: `kCommonConstantReturnTypeSuccess` if successful, else `kCommonConstantReturnTypeError`.
+ */
+CommonConstantReturnType	checkpointOpen(Checkpoint *  C, const char *  path, size_t numberOfCells);
+
+/**
+ *	@brief	Record that the state of a cell has changed since the last checkpoint.
+ *
+ *	@param	C	: Pointer to checkpoint.
+ *	@param	cell	: Index of the cell.
+ */
+void	checkpointMarkDirty(Checkpoint *  C, size_t cell);
+
+/**
+ *	@brief	Record that the state of every cell has changed since the last checkpoint.
+ *
+ *	@param	C	: Pointer to checkpoint.
+ */
+void	checkpointMarkAllDirty(Checkpoint *  C);
+
+/**
+ *	@brief	Copy the changed blocks of `cells` into the inactive image and make it the active one.
+ *
+ *		The copy is not a snapshot: callers must not modify `cells` until this
+ *		returns. Unless `isDurable`, write-back is left to the kernel
+ *		(`MS_ASYNC`), which survives a process crash but not a power loss. With
+ *		`isDurable`, the image reaches storage before the header that publishes it.
+ *		On failure the previous checkpoint stays active and the next call retries
+ *		the same blocks.
+ *
+ *	@param	C			: Pointer to checkpoint.
+ *	@param	cells			: Live state of every cell.
+ *	@param	isDurable		: Wait for the data to reach storage (`MS_SYNC`).
+ *	@param	numberOfBlocksWritten	: If not `NULL`, receives the number of blocks copied.
+ *	@return				: `kCommonConstantReturnTypeSuccess` if successful, else `kCommonConstantReturnTypeError`.
+ */
+CommonConstantReturnType	checkpointWrite(
+					Checkpoint *	C,
+					const Batt *	cells,
+					bool		isDurable,
+					size_t *	numberOfBlocksWritten);
+
+/**
+ *	@brief	Unmap and close a checkpoint.
+ *
+ *	@param	C	: Pointer to checkpoint.
+ */
+void	checkpointClose(Checkpoint *  C);
+
+/**
+ *	@brief	Restore fleet state by mapping a checkpoint file.
+ *
+ *	@param	V	: Pointer to view.
+ *	@param	path	: Path to the checkpoint file.
+ *	@return		: `kCommonConstantReturnTypeSuccess` if successful, else `kCommonConstantReturnTypeError`.
+ */
+CommonConstantReturnType	checkpointRestore(CheckpointView *  V, const char *  path);
+
+/**
+ *	@brief	Unmap a restored view.
+ *
+ *	@param	V	: Pointer to view.
+ */
+void	checkpointRelease(CheckpointView *  V);
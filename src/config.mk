@@ -1,5 +1,15 @@
 SOURCES =\
 	main.c\
 	batt.c\
+	battfloat.c\
+	pack.c\
+	surface.c\
+	route.c\
+	pipeline.c\
+	harness.c\
+	noise.c\
+	checkpoint.c\
+	benchmark.c\
+	counters.c\
 	common.c\
 	utilities.c
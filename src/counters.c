@@ -0,0 +1,339 @@
+/*
+ *	Copyright (c) 2022–2024, Signaloid.
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in all
+ *	copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *	SOFTWARE.
+ */
+
+
+#include "counters.h"
+#include "common.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef BATT_ENABLE_COUNTERS
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+
+_Thread_local CountersBlock *		countersThreadBlock = NULL;
+_Thread_local uint32_t			countersTimerCountdown = kCountersTimerSamplePeriod;
+
+static _Atomic(CountersBlock *)		countersBlocks = NULL;
+static pthread_mutex_t			countersFileMutex = PTHREAD_MUTEX_INITIALIZER;
+static char				countersPath[kCommonConstantMaxCharsPerFilepath];
+
+static const char *	kCounterNames[kCounterMax] = {
+				"batteryUpdate",
+				"batteryExpendedLatch",
+				"voltageToSocLowerSegment",
+				"voltageToSocLinearSegment",
+				"voltageToSocUpperSegment",
+				"socToVoltageLowerSegment",
+				"socToVoltageLinearSegment",
+				"socToVoltageUpperSegment",
+				"mainLoopIteration"};
+static const char *	kTimerNames[kTimerMax] = {
+				"voltageToSocLowerSegment",
+				"voltageToSocLinearSegment",
+				"voltageToSocUpperSegment",
+				"socToVoltage",
+				"polynomialSegments",
+				"sigmoid",
+				"mainLoopIteration"};
+
+CountersBlock *
+countersRegisterThread(void)
+{
+	CountersBlock *	block = (CountersBlock *) checkedMalloc(sizeof(CountersBlock), __FILE__, __LINE__);
+
+	/*
+	 *	Blocks are pushed onto a lock-free list and never freed, so the counts
+	 *	of threads that have exited are still exported.
+	 */
+	memset(block, 0, sizeof(CountersBlock));
+	block->next = atomic_load(&countersBlocks);
+	while (!atomic_compare_exchange_weak(&countersBlocks, &block->next, block))
+	{
+	}
+	countersThreadBlock = block;
+
+	return block;
+}
+
+uint64_t
+countersNanoseconds(void)
+{
+	struct timespec	now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+uint64_t
+countersTimerSample(void)
+{
+	countersTimerCountdown = kCountersTimerSamplePeriod;
+
+	return countersNanoseconds();
+}
+
+void
+countersRecordDuration(TimerIndex timer, uint64_t nanoseconds)
+{
+	CountersBlock *	block = countersBlock();
+	size_t		bucket = 0;
+
+	while ((bucket < kCountersHistogramBuckets - 1) && (nanoseconds >= ((uint64_t) 1 << bucket)))
+	{
+		bucket++;
+	}
+
+	__atomic_store_n(
+		&block->histograms[timer][bucket],
+		__atomic_load_n(&block->histograms[timer][bucket], __ATOMIC_RELAXED) + 1,
+		__ATOMIC_RELAXED);
+	__atomic_store_n(
+		&block->sampledNanoseconds[timer],
+		__atomic_load_n(&block->sampledNanoseconds[timer], __ATOMIC_RELAXED) + nanoseconds,
+		__ATOMIC_RELAXED);
+
+	return;
+}
+
+/**
+ *	@brief	Sum the blocks of all threads.
+ *
+ *	@param	total	: Receives the sums.
+ */
+static void
+countersAggregate(CountersBlock *  total)
+{
+	memset(total, 0, sizeof(CountersBlock));
+
+	for (CountersBlock * block = atomic_load(&countersBlocks); block != NULL; block = block->next)
+	{
+		for (size_t i = 0; i < kCounterMax; i++)
+		{
+			total->counters[i] += __atomic_load_n(&block->counters[i], __ATOMIC_RELAXED);
+		}
+
+		for (size_t i = 0; i < kTimerMax; i++)
+		{
+			total->sampledNanoseconds[i] += __atomic_load_n(&block->sampledNanoseconds[i], __ATOMIC_RELAXED);
+			for (size_t b = 0; b < kCountersHistogramBuckets; b++)
+			{
+				total->histograms[i][b] += __atomic_load_n(&block->histograms[i][b], __ATOMIC_RELAXED);
+			}
+		}
+	}
+
+	return;
+}
+
+static void
+countersWriteJSON(FILE *  file, const CountersBlock *  total)
+{
+	fprintf(file, "{\n\t\"timerSamplePeriod\": %d,\n\t\"counters\": {\n", kCountersTimerSamplePeriod);
+	for (size_t i = 0; i < kCounterMax; i++)
+	{
+		fprintf(file, "\t\t\"%s\": %" PRIu64 "%s\n", kCounterNames[i], total->counters[i], (i + 1 < kCounterMax) ? "," : "");
+	}
+
+	fprintf(file, "\t},\n\t\"timers\": {\n");
+	for (size_t i = 0; i < kTimerMax; i++)
+	{
+		uint64_t	samples = 0;
+
+		for (size_t b = 0; b < kCountersHistogramBuckets; b++)
+		{
+			samples += total->histograms[i][b];
+		}
+
+		fprintf(
+			file,
+			"\t\t\"%s\": {\"samples\": %" PRIu64 ", \"sampledNanoseconds\": %" PRIu64 ", \"histogramBucketUpperBoundsNanoseconds\": \"2^b\", \"histogram\": [",
+			kTimerNames[i],
+			samples,
+			total->sampledNanoseconds[i]);
+		for (size_t b = 0; b < kCountersHistogramBuckets; b++)
+		{
+			fprintf(file, "%" PRIu64 "%s", total->histograms[i][b], (b + 1 < kCountersHistogramBuckets) ? ", " : "");
+		}
+		fprintf(file, "]}%s\n", (i + 1 < kTimerMax) ? "," : "");
+	}
+	fprintf(file, "\t}\n}\n");
+
+	return;
+}
+
+static void
+countersWritePrometheus(FILE *  file, const CountersBlock *  total)
+{
+	fprintf(file, "# HELP batt_calls_total Calls of instrumented estimation kernels and events.\n");
+	fprintf(file, "# TYPE batt_calls_total counter\n");
+	for (size_t i = 0; i < kCounterMax; i++)
+	{
+		fprintf(file, "batt_calls_total{counter=\"%s\"} %" PRIu64 "\n", kCounterNames[i], total->counters[i]);
+	}
+
+	fprintf(file, "# HELP batt_sampled_duration_nanoseconds Sampled durations (1 in %d timer starts per thread).\n", kCountersTimerSamplePeriod);
+	fprintf(file, "# TYPE batt_sampled_duration_nanoseconds histogram\n");
+	for (size_t i = 0; i < kTimerMax; i++)
+	{
+		uint64_t	cumulative = 0;
+
+		for (size_t b = 0; b < kCountersHistogramBuckets; b++)
+		{
+			cumulative += total->histograms[i][b];
+			fprintf(
+				file,
+				"batt_sampled_duration_nanoseconds_bucket{timer=\"%s\",le=\"%" PRIu64 "\"} %" PRIu64 "\n",
+				kTimerNames[i],
+				(uint64_t) 1 << b,
+				cumulative);
+		}
+		fprintf(file, "batt_sampled_duration_nanoseconds_bucket{timer=\"%s\",le=\"+Inf\"} %" PRIu64 "\n", kTimerNames[i], cumulative);
+		fprintf(file, "batt_sampled_duration_nanoseconds_sum{timer=\"%s\"} %" PRIu64 "\n", kTimerNames[i], total->sampledNanoseconds[i]);
+		fprintf(file, "batt_sampled_duration_nanoseconds_count{timer=\"%s\"} %" PRIu64 "\n", kTimerNames[i], cumulative);
+	}
+
+	return;
+}
+
+CommonConstantReturnType
+countersWrite(void)
+{
+	CountersBlock	total;
+	size_t		length = strlen(countersPath);
+	FILE *		file;
+
+	if (length == 0)
+	{
+		return kCommonConstantReturnTypeError;
+	}
+
+	/*
+	 *	The exporter thread and the exit handler may write at the same time.
+	 */
+	pthread_mutex_lock(&countersFileMutex);
+	file = fopen(countersPath, "w");
+	if (file == NULL)
+	{
+		pthread_mutex_unlock(&countersFileMutex);
+		fprintf(stderr, "Error: Could not write counters to \"%s\".\n", countersPath);
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	countersAggregate(&total);
+	if ((length >= 5) && (strcmp(&countersPath[length - 5], ".prom") == 0))
+	{
+		countersWritePrometheus(file, &total);
+	}
+	else
+	{
+		countersWriteJSON(file, &total);
+	}
+	fclose(file);
+	pthread_mutex_unlock(&countersFileMutex);
+
+	return kCommonConstantReturnTypeSuccess;
+}
+
+static void
+countersWriteAtExit(void)
+{
+	countersWrite();
+
+	return;
+}
+
+/**
+ *	@brief	Exporter thread: write the counters each time SIGUSR1 arrives.
+ *
+ *		SIGUSR1 is blocked in every other thread, so it is taken here by
+ *		`sigwait` rather than by a handler, and the file can be written
+ *		directly whatever the other threads are doing.
+ *
+ *	@param	argument	: Pointer to the blocked signal set.
+ *	@return			: Never returns.
+ */
+static void *
+countersExporterThread(void *  argument)
+{
+	const sigset_t *	signals = (const sigset_t *) argument;
+
+	while (true)
+	{
+		int	signalNumber;
+
+		if (sigwait(signals, &signalNumber) == 0)
+		{
+			countersWrite();
+		}
+	}
+
+	return NULL;
+}
+
+CommonConstantReturnType
+countersInstall(const char *  path)
+{
+	static sigset_t	signals;
+	pthread_t	exporter;
+
+	snprintf(countersPath, sizeof(countersPath), "%s", path);
+
+	/*
+	 *	Called before any other thread is started, so the threads of all
+	 *	modes (pipeline stages, OpenMP workers) inherit the blocked signal.
+	 */
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGUSR1);
+	if ((atexit(countersWriteAtExit) != 0) ||
+		(pthread_sigmask(SIG_BLOCK, &signals, NULL) != 0) ||
+		(pthread_create(&exporter, NULL, countersExporterThread, &signals) != 0))
+	{
+		fprintf(stderr, "Error: Could not install counters export.\n");
+
+		return kCommonConstantReturnTypeError;
+	}
+	pthread_detach(exporter);
+
+	return kCommonConstantReturnTypeSuccess;
+}
+#else
+CommonConstantReturnType
+countersInstall(const char *  path)
+{
+	fprintf(stderr, "Error: Cannot write counters to \"%s\": build with -DBATT_ENABLE_COUNTERS to enable them.\n", path);
+
+	return kCommonConstantReturnTypeError;
+}
+
+CommonConstantReturnType
+countersWrite(void)
+{
+	return kCommonConstantReturnTypeError;
+}
+#endif
@@ -0,0 +1,218 @@
+/*
+ *	Copyright (c) 2022-2024, Signaloid.
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in all
+ *	copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *	SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <inttypes.h>
+#include <stdint.h>
+#include "common.h"
+
+/*
+ *	Hot-path counters for the estimation kernels, compiled in only when building
+ *	with `-DBATT_ENABLE_COUNTERS`. Building with `-DBATT_ENABLE_COUNTER_TIMERS`
+ *	adds sampled timing histograms, which raise the overhead on the kernels from
+ *	about 3.5% to about 10% (see the fleet benchmark) and so are a separate flag.
+ *	Otherwise the `COUNTERS_*` macros expand to nothing.
+ */
+#if defined(BATT_ENABLE_COUNTER_TIMERS) && !defined(BATT_ENABLE_COUNTERS)
+#define	BATT_ENABLE_COUNTERS
+#endif
+
+typedef enum
+{
+	kCounterBatteryUpdate		= 0,
+	kCounterBatteryExpendedLatch,
+	kCounterVoltageToSocLowerSegment,
+	kCounterVoltageToSocLinearSegment,
+	kCounterVoltageToSocUpperSegment,
+	kCounterSocToVoltageLowerSegment,
+	kCounterSocToVoltageLinearSegment,
+	kCounterSocToVoltageUpperSegment,
+	kCounterMainLoopIteration,
+	kCounterMax,
+} CounterIndex;
+
+typedef enum
+{
+	kTimerVoltageToSocLowerSegment	= 0,
+	kTimerVoltageToSocLinearSegment,
+	kTimerVoltageToSocUpperSegment,
+	kTimerSocToVoltage,
+	kTimerPolynomialSegments,
+	kTimerSigmoid,
+	kTimerMainLoopIteration,
+	kTimerMax,
+} TimerIndex;
+
+/*
+ *	One in `kCountersTimerSamplePeriod` timer starts on each thread reads the
+ *	clock. The period is prime so that loops which start a fixed number of
+ *	timers per iteration still have each of them sampled. Histogram bucket `b`
+ *	counts sampled durations below 2^b ns.
+ */
+#define	kCountersTimerSamplePeriod	(1021)
+#define	kCountersHistogramBuckets	(32)
+
+typedef struct CountersBlock
+{
+	uint64_t		counters[kCounterMax];
+	uint64_t		histograms[kTimerMax][kCountersHistogramBuckets];
+	uint64_t		sampledNanoseconds[kTimerMax];
+	struct CountersBlock *	next;
+} CountersBlock;
+
+/**
+ *	@brief	Write counters to `path` at exit and, from an exporter thread, whenever
+ *		SIGUSR1 is received. Paths ending in `.prom` get Prometheus text format,
+ *		others JSON. Must be called before any other thread is started, since it
+ *		blocks SIGUSR1 in the calling thread for all threads to inherit.
+ *
+ *	@param	path	: Path to the output file.
+ *	@return		: `kCommonConstantReturnTypeSuccess` if successful, else `kCommonConstantReturnTypeError`.
+ */
+CommonConstantReturnType	countersInstall(const char *  path);
+
+/**
+ *	@brief	Write the counters of all threads to the installed file now.
+ *
+ *	@return		: `kCommonConstantReturnTypeSuccess` if successful, else `kCommonConstantReturnTypeError`.
+ */
+CommonConstantReturnType	countersWrite(void);
+
+#ifdef BATT_ENABLE_COUNTERS
+
+extern _Thread_local CountersBlock *	countersThreadBlock;
+extern _Thread_local uint32_t		countersTimerCountdown;
+
+/**
+ *	@brief	Allocate and register the counters of the calling thread.
+ *
+ *	@return		: Counters of the calling thread.
+ */
+CountersBlock *	countersRegisterThread(void);
+
+/**
+ *	@brief	Monotonic clock for the sampled timers.
+ *
+ *	@return		: Current time (ns).
+ */
+uint64_t	countersNanoseconds(void);
+
+/**
+ *	@brief	Start a sampled timer and restart the countdown to the next sample.
+ *
+ *	@return		: Current time (ns).
+ */
+uint64_t	countersTimerSample(void);
+
+/**
+ *	@brief	Add a sampled duration to a timer histogram.
+ *
+ *	@param	timer		: Timer.
+ *	@param	nanoseconds	: Duration.
+ */
+void	countersRecordDuration(TimerIndex timer, uint64_t nanoseconds);
+
+static inline CountersBlock *
+countersBlock(void)
+{
+	CountersBlock *	block = countersThreadBlock;
+
+	return (block != NULL) ? block : countersRegisterThread();
+}
+
+/*
+ *	Each thread only writes its own block; exporters on other threads may read
+ *	a count that is one behind. Relaxed atomic loads and stores keep that
+ *	well-defined without the cost of a locked read-modify-write.
+ */
+static inline void
+countersIncrementBlock(CountersBlock *  block, CounterIndex counter)
+{
+	uint64_t *	count = &block->counters[counter];
+
+	__atomic_store_n(count, __atomic_load_n(count, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+}
+
+/*
+ *	`COUNTERS_BLOCK` looks up the counters of the calling thread once, so that a
+ *	kernel or batch loop can pass them to `COUNTERS_INCREMENT_BLOCK` instead of
+ *	paying a thread-local lookup per increment. It is `NULL` when the counters
+ *	are compiled out.
+ */
+#define	COUNTERS_BLOCK()				countersBlock()
+#define	COUNTERS_INCREMENT_BLOCK(block, counter)	countersIncrementBlock(block, counter)
+#define	COUNTERS_INCREMENT(counter)			countersIncrementBlock(countersBlock(), counter)
+
+#ifdef BATT_ENABLE_COUNTER_TIMERS
+/*
+ *	Returns zero for timer starts that are not sampled.
+ */
+static inline uint64_t
+countersTimerStart(void)
+{
+	return (__builtin_expect(--countersTimerCountdown == 0, 0)) ? countersTimerSample() : 0;
+}
+
+static inline void
+countersTimerStop(TimerIndex timer, uint64_t start)
+{
+	if (__builtin_expect(start != 0, 0))
+	{
+		countersRecordDuration(timer, countersNanoseconds() - start);
+	}
+}
+
+static inline void
+countersTimerLap(TimerIndex timer, uint64_t *  lap)
+{
+	if (__builtin_expect(*lap != 0, 0))
+	{
+		uint64_t	now = countersNanoseconds();
+
+		countersRecordDuration(timer, now - *lap);
+		*lap = now;
+	}
+}
+
+/*
+ *	Only `COUNTERS_TIMER_START` decides whether to sample. A sampled kernel can
+ *	then split its duration into phases with `COUNTERS_TIMER_LAP`, each of which
+ *	records the time since the previous lap; unsampled laps cost one branch.
+ */
+#define	COUNTERS_TIMER_START(name)		uint64_t name = countersTimerStart(); uint64_t __attribute__((unused)) name##Lap = name
+#define	COUNTERS_TIMER_LAP(timer, name)		countersTimerLap(timer, &name##Lap)
+#define	COUNTERS_TIMER_STOP(timer, name)	countersTimerStop(timer, name)
+#else
+#define	COUNTERS_TIMER_START(name)		do {} while (0)
+#define	COUNTERS_TIMER_LAP(timer, name)		do {} while (0)
+#define	COUNTERS_TIMER_STOP(timer, name)	do {} while (0)
+#endif
+#else
+#define	COUNTERS_BLOCK()				((CountersBlock *) NULL)
+#define	COUNTERS_INCREMENT_BLOCK(block, counter)	do { (void) (block); (void) (counter); } while (0)
+#define	COUNTERS_INCREMENT(counter)			do {} while (0)
+#define	COUNTERS_TIMER_START(name)		do {} while (0)
+#define	COUNTERS_TIMER_LAP(timer, name)		do {} while (0)
+#define	COUNTERS_TIMER_STOP(timer, name)	do {} while (0)
+#endif
@@ -0,0 +1,449 @@
+/*
+ *	Copyright (c) 2022–2024, Signaloid.
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in all
+ *	copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *	SOFTWARE.
+ */
+
+
+#include "harness.h"
+#include "batt.h"
+#include "battfloat.h"
+#include "common.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <uxhw.h>
+
+
+/*
+ *	The generated reference uses stratified sampling and the exact curve at
+ *	`kHarnessReferenceIterations` points.
+ */
+#define	kHarnessReferenceIterations	(1000000)
+#define	kHarnessMaxCharsPerLine		(256)
+
+/*
+ *	Each configuration is timed this many times and its median time reported.
+ */
+#define	kHarnessTimingRepeats		(7)
+
+/*
+ *	Resolutions at which the table prints distances and times. Results are
+ *	compared at these resolutions, so that the Pareto marks agree with the
+ *	printed values.
+ */
+const double	kHarnessDistanceResolution = 1E-8;
+const double	kHarnessTimeResolution = 1E-6;
+
+/*
+ *	Tabulated `voltageToSoc` with linear interpolation. Inputs outside the
+ *	table are clamped to its ends.
+ */
+#define	kHarnessTableSize		(4096)
+const double	kHarnessTableVoltageMin = 2.0;
+const double	kHarnessTableVoltageMax = 4.4;
+
+const size_t	kHarnessIterationCounts[] = {10, 100, 1000, 10000, 100000};
+const char *	kHarnessSamplingSchemeNames[kHarnessSamplingSchemeMax] = {"random", "stratified"};
+const char *	kHarnessEvaluationModeNames[kHarnessEvaluationModeMax] = {"curve", "table", "float"};
+
+static int
+compareDoubles(const void *  a, const void *  b)
+{
+	double	x = *(const double *) a;
+	double	y = *(const double *) b;
+
+	return (x > y) - (x < y);
+}
+
+static int
+compareResultsByTime(const void *  a, const void *  b)
+{
+	return compareDoubles(
+			&((const HarnessResult *) a)->cpuTimeUsedInSeconds,
+			&((const HarnessResult *) b)->cpuTimeUsedInSeconds);
+}
+
+/**
+ *	@brief	Whether result `a` Pareto-dominates result `b` in time and accuracy.
+ *
+ *		Both axes are compared at the resolution of the printed table, so
+ *		results that print the same are not ranked against each other.
+ *
+ *	@param	a	: Candidate dominating result.
+ *	@param	b	: Candidate dominated result.
+ *	@return		: `true` if `a` is no worse than `b` on both axes and strictly better on one.
+ */
+static bool
+harnessDominates(const HarnessResult *  a, const HarnessResult *  b)
+{
+	double	timeA = round(a->cpuTimeUsedInSeconds / kHarnessTimeResolution);
+	double	timeB = round(b->cpuTimeUsedInSeconds / kHarnessTimeResolution);
+	double	distanceA = round(a->wassersteinDistance / kHarnessDistanceResolution);
+	double	distanceB = round(b->wassersteinDistance / kHarnessDistanceResolution);
+	bool	isNoWorse = (timeA <= timeB) && (distanceA <= distanceB);
+	bool	isBetter = (timeA < timeB) || (distanceA < distanceB);
+
+	return isNoWorse && isBetter;
+}
+
+/**
+ *	@brief	Inverse of the standard normal cumulative distribution function.
+ *
+ *		Rational approximation by P. J. Acklam (relative error below 1.2E-9).
+ *
+ *	@param	p	: Probability in (0, 1).
+ *	@return		: Quantile.
+ */
+static double
+inverseStandardNormal(double p)
+{
+	const double	a[] = {-3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02, 1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00};
+	const double	b[] = {-5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02, 6.680131188771972e+01, -1.328068155288572e+01};
+	const double	c[] = {-7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00, -2.549732445397187e+00, 4.374664141464968e+00, 2.938163982698783e+00};
+	const double	d[] = {7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00, 3.754408661907416e+00};
+	const double	pLow = 0.02425;
+	double		q;
+	double		r;
+
+	if (p < pLow)
+	{
+		q = sqrt(-2 * log(p));
+
+		return (((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) /
+			((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+	}
+
+	if (p > 1 - pLow)
+	{
+		q = sqrt(-2 * log(1 - p));
+
+		return -(((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) /
+			((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+	}
+
+	q = p - 0.5;
+	r = q * q;
+
+	return (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5]) * q /
+		(((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1);
+}
+
+/**
+ *	@brief	Draw measured voltages and estimate the state of charge for each.
+ *
+ *	@param	samplingScheme				: Sampling scheme.
+ *	@param	evaluationMode				: Evaluation mode.
+ *	@param	table					: `voltageToSoc` table for `kHarnessEvaluationModeTable`.
+ *	@param	measuredVoltageMean			: Mean of the measured voltage.
+ *	@param	measuredVoltageStandardDeviation	: Standard deviation of the measured voltage.
+ *	@param	outputSamples				: Receives `numberOfIterations` state of charge samples.
+ *	@param	numberOfIterations			: Number of samples.
+ */
+static void
+estimateSamples(
+	HarnessSamplingScheme	samplingScheme,
+	HarnessEvaluationMode	evaluationMode,
+	const double *		table,
+	double			measuredVoltageMean,
+	double			measuredVoltageStandardDeviation,
+	double *		outputSamples,
+	size_t			numberOfIterations)
+{
+	const double	tableStep = (kHarnessTableVoltageMax - kHarnessTableVoltageMin) / (kHarnessTableSize - 1);
+
+	for (size_t i = 0; i < numberOfIterations; i++)
+	{
+		double	measuredVoltage;
+
+		if (samplingScheme == kHarnessSamplingSchemeStratified)
+		{
+			measuredVoltage = measuredVoltageMean + measuredVoltageStandardDeviation *
+						inverseStandardNormal((i + 0.5) / numberOfIterations);
+		}
+		else
+		{
+			measuredVoltage = UxHwDoubleGaussDist(measuredVoltageMean, measuredVoltageStandardDeviation);
+		}
+
+		if (evaluationMode == kHarnessEvaluationModeTable)
+		{
+			double	position = (measuredVoltage - kHarnessTableVoltageMin) / tableStep;
+			size_t	index;
+
+			position = fmin(fmax(position, 0), kHarnessTableSize - 1);
+			index = fmin(position, kHarnessTableSize - 2);
+			outputSamples[i] = table[index] + (position - index) * (table[index + 1] - table[index]);
+		}
+		else if (evaluationMode == kHarnessEvaluationModeFloat)
+		{
+			outputSamples[i] = voltageToSocFloat((float) measuredVoltage);
+		}
+		else
+		{
+			outputSamples[i] = voltageToSoc(measuredVoltage);
+		}
+	}
+
+	return;
+}
+
+/**
+ *	@brief	Load reference samples, one per line. Lines that do not parse are skipped.
+ *
+ *	@param	referenceFilePath	: Path to the file.
+ *	@param	numberOfSamples		: Receives the number of samples.
+ *	@return				: Samples, or `NULL` on error.
+ */
+static double *
+loadReferenceSamples(const char *  referenceFilePath, size_t *  numberOfSamples)
+{
+	char		line[kHarnessMaxCharsPerLine];
+	size_t		capacity = 1024;
+	double *	samples;
+	FILE *		file = fopen(referenceFilePath, "r");
+
+	if (file == NULL)
+	{
+		fprintf(stderr, "Error: Could not open reference file \"%s\".\n", referenceFilePath);
+
+		return NULL;
+	}
+
+	*numberOfSamples = 0;
+	samples = (double *) checkedMalloc(capacity * sizeof(double), __FILE__, __LINE__);
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		char *	end;
+		double	value = strtod(line, &end);
+
+		if (end == line)
+		{
+			continue;
+		}
+
+		if (*numberOfSamples == capacity)
+		{
+			double *	grown = (double *) checkedMalloc(2 * capacity * sizeof(double), __FILE__, __LINE__);
+
+			memcpy(grown, samples, capacity * sizeof(double));
+			free(samples);
+			samples = grown;
+			capacity *= 2;
+		}
+
+		samples[(*numberOfSamples)++] = value;
+	}
+	fclose(file);
+
+	if (*numberOfSamples == 0)
+	{
+		fprintf(stderr, "Error: Reference file \"%s\" contains no samples.\n", referenceFilePath);
+		free(samples);
+
+		return NULL;
+	}
+
+	return samples;
+}
+
+double
+harnessWassersteinDistance(
+	double *	samplesA,
+	size_t		numberOfSamplesA,
+	double *	samplesB,
+	size_t		numberOfSamplesB)
+{
+	double	distance = 0.0;
+	double	previous;
+	size_t	i = 0;
+	size_t	j = 0;
+
+	qsort(samplesA, numberOfSamplesA, sizeof(double), compareDoubles);
+	qsort(samplesB, numberOfSamplesB, sizeof(double), compareDoubles);
+
+	/*
+	 *	W1 = integral(|F_A(x) - F_B(x)|, x). Both empirical distribution functions
+	 *	are step functions, so walk the merged sorted samples.
+	 */
+	previous = fmin(samplesA[0], samplesB[0]);
+	while ((i < numberOfSamplesA) || (j < numberOfSamplesB))
+	{
+		double	next;
+
+		if ((j == numberOfSamplesB) || ((i < numberOfSamplesA) && (samplesA[i] <= samplesB[j])))
+		{
+			next = samplesA[i];
+		}
+		else
+		{
+			next = samplesB[j];
+		}
+
+		distance += fabs((double) i / numberOfSamplesA - (double) j / numberOfSamplesB) * (next - previous);
+		previous = next;
+
+		if ((i < numberOfSamplesA) && (samplesA[i] == next))
+		{
+			i++;
+		}
+		else
+		{
+			j++;
+		}
+	}
+
+	return distance;
+}
+
+CommonConstantReturnType
+harnessRun(
+	const char *	referenceFilePath,
+	double		measuredVoltageMean,
+	double		measuredVoltageStandardDeviation,
+	FILE *		stream)
+{
+	const size_t	numberOfIterationCounts = sizeof(kHarnessIterationCounts) / sizeof(kHarnessIterationCounts[0]);
+	const size_t	maxIterations = kHarnessIterationCounts[numberOfIterationCounts - 1];
+	const size_t	numberOfResults = kHarnessSamplingSchemeMax * kHarnessEvaluationModeMax * numberOfIterationCounts;
+	HarnessResult *	results = (HarnessResult *) checkedMalloc(numberOfResults * sizeof(HarnessResult), __FILE__, __LINE__);
+	double *	samples = (double *) checkedMalloc(maxIterations * sizeof(double), __FILE__, __LINE__);
+	double		table[kHarnessTableSize];
+	double *	reference;
+	size_t		numberOfReferenceSamples;
+	size_t		r = 0;
+
+	/*
+	 *	Load or generate the reference once.
+	 */
+	if (referenceFilePath != NULL)
+	{
+		reference = loadReferenceSamples(referenceFilePath, &numberOfReferenceSamples);
+		if (reference == NULL)
+		{
+			free(results);
+			free(samples);
+
+			return kCommonConstantReturnTypeError;
+		}
+	}
+	else
+	{
+		numberOfReferenceSamples = kHarnessReferenceIterations;
+		reference = (double *) checkedMalloc(numberOfReferenceSamples * sizeof(double), __FILE__, __LINE__);
+		estimateSamples(
+			kHarnessSamplingSchemeStratified,
+			kHarnessEvaluationModeCurve,
+			NULL,
+			measuredVoltageMean,
+			measuredVoltageStandardDeviation,
+			reference,
+			numberOfReferenceSamples);
+	}
+
+	/*
+	 *	The table is built once, outside the timed region, as a deployment would.
+	 */
+	for (size_t i = 0; i < kHarnessTableSize; i++)
+	{
+		table[i] = voltageToSoc(kHarnessTableVoltageMin + i * (kHarnessTableVoltageMax - kHarnessTableVoltageMin) / (kHarnessTableSize - 1));
+	}
+
+	for (HarnessSamplingScheme scheme = 0; scheme < kHarnessSamplingSchemeMax; scheme++)
+	{
+		for (HarnessEvaluationMode mode = 0; mode < kHarnessEvaluationModeMax; mode++)
+		{
+			for (size_t k = 0; k < numberOfIterationCounts; k++)
+			{
+				double	times[kHarnessTimingRepeats];
+
+				/*
+				 *	The distance is taken from the samples of the last repeat.
+				 */
+				for (size_t repeat = 0; repeat < kHarnessTimingRepeats; repeat++)
+				{
+					clock_t	start = clock();
+
+					estimateSamples(
+						scheme,
+						mode,
+						table,
+						measuredVoltageMean,
+						measuredVoltageStandardDeviation,
+						samples,
+						kHarnessIterationCounts[k]);
+					times[repeat] = ((double) (clock() - start)) / CLOCKS_PER_SEC;
+				}
+				qsort(times, kHarnessTimingRepeats, sizeof(double), compareDoubles);
+
+				results[r] = (HarnessResult) {
+					.samplingScheme		= scheme,
+					.evaluationMode		= mode,
+					.numberOfIterations	= kHarnessIterationCounts[k],
+					.cpuTimeUsedInSeconds	= times[kHarnessTimingRepeats / 2],
+				};
+				results[r].wassersteinDistance = harnessWassersteinDistance(
+									samples,
+									kHarnessIterationCounts[k],
+									reference,
+									numberOfReferenceSamples);
+				r++;
+			}
+		}
+	}
+
+	/*
+	 *	A configuration is Pareto-optimal if no other is at least as fast and
+	 *	at least as accurate while being strictly better in one of the two.
+	 */
+	qsort(results, numberOfResults, sizeof(HarnessResult), compareResultsByTime);
+	for (size_t i = 0; i < numberOfResults; i++)
+	{
+		results[i].isParetoOptimal = true;
+		for (size_t j = 0; j < numberOfResults; j++)
+		{
+			if (harnessDominates(&results[j], &results[i]))
+			{
+				results[i].isParetoOptimal = false;
+				break;
+			}
+		}
+	}
+
+	fprintf(stream, "%-12s %-8s %12s %16s %12s %s\n", "sampling", "mode", "iterations", "wasserstein", "time(us)", "pareto");
+	for (size_t i = 0; i < numberOfResults; i++)
+	{
+		fprintf(
+			stream,
+			"%-12s %-8s %12zu %16.8lf %12" PRIu64 " %s\n",
+			kHarnessSamplingSchemeNames[results[i].samplingScheme],
+			kHarnessEvaluationModeNames[results[i].evaluationMode],
+			results[i].numberOfIterations,
+			results[i].wassersteinDistance,
+			(uint64_t) round(results[i].cpuTimeUsedInSeconds / kHarnessTimeResolution),
+			results[i].isParetoOptimal ? "*" : "");
+	}
+
+	free(results);
+	free(samples);
+	free(reference);
+
+	return kCommonConstantReturnTypeSuccess;
+}
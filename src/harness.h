@@ -0,0 +1,88 @@
+/*
+ *	Copyright (c) 2022-2024, Signaloid.
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in all
+ *	copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *	SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "common.h"
+
+typedef enum
+{
+	kHarnessSamplingSchemeRandom		= 0,
+	kHarnessSamplingSchemeStratified,
+	kHarnessSamplingSchemeMax,
+} HarnessSamplingScheme;
+
+typedef enum
+{
+	kHarnessEvaluationModeCurve		= 0,
+	kHarnessEvaluationModeTable,
+	kHarnessEvaluationModeFloat,
+	kHarnessEvaluationModeMax,
+} HarnessEvaluationMode;
+
+typedef struct
+{
+	HarnessSamplingScheme	samplingScheme;
+	HarnessEvaluationMode	evaluationMode;
+	size_t			numberOfIterations;
+	double			wassersteinDistance;
+	double			cpuTimeUsedInSeconds;
+	bool			isParetoOptimal;
+} HarnessResult;
+
+/**
+ *	@brief	1-Wasserstein distance between two empirical distributions.
+ *
+ *	@param	samplesA		: Samples of the first distribution. Sorted in place.
+ *	@param	numberOfSamplesA	: Number of entries in `samplesA`.
+ *	@param	samplesB		: Samples of the second distribution. Sorted in place.
+ *	@param	numberOfSamplesB	: Number of entries in `samplesB`.
+ *	@return				: Distance, in the units of the samples.
+ */
+double	harnessWassersteinDistance(
+		double *	samplesA,
+		size_t		numberOfSamplesA,
+		double *	samplesB,
+		size_t		numberOfSamplesB);
+
+/**
+ *	@brief	Sweep iteration counts, sampling schemes and evaluation modes of the state of charge
+ *		estimate for a Gaussian measured voltage, and print the accuracy and cost of each as a
+ *		table with the Pareto-optimal configurations marked. Each configuration is timed
+ *		several times and its median time reported; distances and times are compared at
+ *		the precision they are printed at.
+ *
+ *	@param	referenceFilePath		: File of reference state of charge samples, one per line. If `NULL`, a reference is generated.
+ *	@param	measuredVoltageMean		: Mean of the measured voltage.
+ *	@param	measuredVoltageStandardDeviation: Standard deviation of the measured voltage.
+ *	@param	stream				: Output stream for the table.
+ *	@return					: `kCommonConstantReturnTypeSuccess` if successful, else `kCommonConstantReturnTypeError`.
+ */
+CommonConstantReturnType	harnessRun(
+					const char *	referenceFilePath,
+					double		measuredVoltageMean,
+					double		measuredVoltageStandardDeviation,
+					FILE *		stream);
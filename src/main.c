@@ -24,6 +24,10 @@
 #include <stdio.h>
 #include <math.h>
 #include "batt.h"
+#include "benchmark.h"
+#include "counters.h"
+#include "harness.h"
+#include "pipeline.h"
 #include "utilities.h"
 #include "common.h"
 #include <uxhw.h>
@@ -52,6 +56,71 @@ setInputVariables(
 	return;
 }
 
+/**
+ *	@brief	Estimate the state of charge for every measured voltage in the input file.
+ *
+ *	@param	arguments	: Pointer to command-line arguments struct.
+ *	@return			: `EXIT_SUCCESS` if successful, else `EXIT_FAILURE`.
+ */
+static int
+runPipelinedMode(CommandLineArguments *  arguments)
+{
+	PipelineStatistics		statistics;
+	CommonConstantReturnType	result;
+	FILE *				input;
+	FILE *				output = stdout;
+
+	input = fopen(arguments->common.inputFilePath, "r");
+	if (input == NULL)
+	{
+		fprintf(stderr, "Error: Could not open input file \"%s\".\n", arguments->common.inputFilePath);
+
+		return EXIT_FAILURE;
+	}
+
+	if (arguments->common.isWriteToFileEnabled)
+	{
+		output = fopen(arguments->common.outputFilePath, "w");
+		if (output == NULL)
+		{
+			fprintf(stderr, "Error: Could not write to output CSV file \"%s\".\n", arguments->common.outputFilePath);
+			fclose(input);
+
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (fprintf(output, "stateOfCharge\n") < 0)
+	{
+		fprintf(stderr, "Error: Could not write pipeline output.\n");
+		fclose(input);
+		if (output != stdout)
+		{
+			fclose(output);
+		}
+
+		return EXIT_FAILURE;
+	}
+
+	result = pipelineRun(input, output, voltageToSoc, arguments->numberOfPipelineWorkers, &statistics);
+
+	fclose(input);
+	if (output != stdout)
+	{
+		fclose(output);
+	}
+
+	/*
+	 *	Print per-stage utilization if timing is enabled.
+	 */
+	if (arguments->common.isTimingEnabled)
+	{
+		pipelinePrintStatistics(stderr, &statistics);
+	}
+
+	return (result == kCommonConstantReturnTypeSuccess) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 int
 main(int argc, char * argv[])
 {
@@ -76,6 +145,44 @@ main(int argc, char * argv[])
 		return EXIT_FAILURE;
 	}
 
+	/*
+	 *	Write the hot-path counters at exit if requested.
+	 */
+	if (arguments.isProfileFileSet && (countersInstall(arguments.profileFilePath) != kCommonConstantReturnTypeSuccess))
+	{
+		return EXIT_FAILURE;
+	}
+
+	/*
+	 *	Run the accuracy-versus-cost sweep if in harness mode.
+	 */
+	if (arguments.isHarnessMode)
+	{
+		return (harnessRun(
+				arguments.isReferenceFileSet ? arguments.referenceFilePath : NULL,
+				kDemoSpecificConstantMeasuredVoltageGaussianMean,
+				kDemoSpecificConstantMeasuredVoltageGaussianStandardDeviation,
+				stdout) == kCommonConstantReturnTypeSuccess) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	/*
+	 *	Run the fleet-scale benchmarks if in fleet benchmark mode.
+	 */
+	if (arguments.isFleetBenchmarkMode)
+	{
+		return (benchmarkFleet(
+				arguments.numberOfFleetBenchmarkCells,
+				stdout) == kCommonConstantReturnTypeSuccess) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	/*
+	 *	Run in pipelined mode if reading inputs from file.
+	 */
+	if (arguments.common.isInputFromFileEnabled)
+	{
+		return runPipelinedMode(&arguments);
+	}
+
 	/*
 	 *	Allocate for monteCarloOutputSamples if in Monte Carlo mode.
 	 */
@@ -97,6 +204,9 @@ main(int argc, char * argv[])
 
 	for (size_t i = 0; i < arguments.common.numberOfMonteCarloIterations; ++i)
 	{
+		COUNTERS_INCREMENT(kCounterMainLoopIteration);
+		COUNTERS_TIMER_START(iterationStart);
+
 		/*
 		 *	Set inputs either from command-line arguments or via UxHw calls.
 		 */
@@ -122,6 +232,8 @@ main(int argc, char * argv[])
 		{
 			benchmarkOutput = outputVariables[kOutputDistributionIndexStateOfCharge];
 		}
+
+		COUNTERS_TIMER_STOP(kTimerMainLoopIteration, iterationStart);
 	}
 
 	/*
@@ -0,0 +1,193 @@
+/*
+ *	Copyright (c) 2022–2024, Signaloid.
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in all
+ *	copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *	SOFTWARE.
+ */
+
+
+#include "noise.h"
+#include "common.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <uxhw.h>
+
+
+/*
+ *	Successive differences larger than `kNoiseClipScale` times the current
+ *	mean absolute difference are clipped before entering the window.
+ */
+const double	kNoiseClipScale = 4.0;
+
+/*
+ *	Lower bound on the clipping threshold (V), about one step of a 12-bit ADC
+ *	over 4.2 V. Without it, a window of identical readings would have a zero
+ *	threshold and clip every later difference to zero, so the estimate could
+ *	never leave zero again.
+ */
+const double	kNoiseClipMinimum = 1E-3;
+
+/*
+ *	For independent Gaussian noise, E|x[i] - x[i-1]| = 2 * sigma / sqrt(pi).
+ */
+const double	kNoiseAbsoluteDifferenceToStandardDeviation = 0.886226925452758;
+
+CommonConstantReturnType
+noiseWindowsInitialize(NoiseWindows *  W, size_t numberOfCells, size_t windowSize)
+{
+	if (windowSize == 0)
+	{
+		fprintf(stderr, "Error: The noise window size must be positive.\n");
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	W->numberOfCells = numberOfCells;
+	W->windowSize = windowSize;
+	W->readings = (double *) checkedMalloc(numberOfCells * windowSize * sizeof(double), __FILE__, __LINE__);
+	W->clippedAbsoluteDifferences = (double *) checkedMalloc(numberOfCells * windowSize * sizeof(double), __FILE__, __LINE__);
+	W->mean = (double *) checkedMalloc(numberOfCells * sizeof(double), __FILE__, __LINE__);
+	W->sumOfSquaredDeviations = (double *) checkedMalloc(numberOfCells * sizeof(double), __FILE__, __LINE__);
+	W->sumOfClippedAbsoluteDifferences = (double *) checkedMalloc(numberOfCells * sizeof(double), __FILE__, __LINE__);
+	W->latest = (double *) checkedMalloc(numberOfCells * sizeof(double), __FILE__, __LINE__);
+	W->numberOfReadings = (uint64_t *) checkedMalloc(numberOfCells * sizeof(uint64_t), __FILE__, __LINE__);
+
+	memset(W->mean, 0, numberOfCells * sizeof(double));
+	memset(W->sumOfSquaredDeviations, 0, numberOfCells * sizeof(double));
+	memset(W->sumOfClippedAbsoluteDifferences, 0, numberOfCells * sizeof(double));
+	memset(W->latest, 0, numberOfCells * sizeof(double));
+	memset(W->numberOfReadings, 0, numberOfCells * sizeof(uint64_t));
+
+	return kCommonConstantReturnTypeSuccess;
+}
+
+void
+noiseWindowsFree(NoiseWindows *  W)
+{
+	free(W->readings);
+	free(W->clippedAbsoluteDifferences);
+	free(W->mean);
+	free(W->sumOfSquaredDeviations);
+	free(W->sumOfClippedAbsoluteDifferences);
+	free(W->latest);
+	free(W->numberOfReadings);
+
+	return;
+}
+
+void
+noiseWindowUpdate(NoiseWindows *  W, size_t cell, double reading)
+{
+	uint64_t	n = W->numberOfReadings[cell];
+	size_t		slot = (n % W->windowSize) * W->numberOfCells + cell;
+	size_t		numberOfDifferences = (n == 0) ? 0 : ((n - 1 < W->windowSize) ? n - 1 : W->windowSize);
+	double		absoluteDifference = 0.0;
+
+	/*
+	 *	Clipped absolute difference to the previous reading. The first reading
+	 *	has none; its slot holds zero so that evicting it is a no-op.
+	 */
+	if (n > 0)
+	{
+		double	meanAbsoluteDifference = W->sumOfClippedAbsoluteDifferences[cell] / numberOfDifferences;
+
+		absoluteDifference = fabs(reading - W->latest[cell]);
+		if (numberOfDifferences > 1)
+		{
+			absoluteDifference = fmin(absoluteDifference, fmax(kNoiseClipScale * meanAbsoluteDifference, kNoiseClipMinimum));
+		}
+	}
+
+	if (n < W->windowSize)
+	{
+		/*
+		 *	Window not yet full: Welford's update.
+		 */
+		double	delta = reading - W->mean[cell];
+
+		W->mean[cell] += delta / (n + 1);
+		W->sumOfSquaredDeviations[cell] += delta * (reading - W->mean[cell]);
+	}
+	else
+	{
+		/*
+		 *	Window full: replace the oldest reading in Welford's sums.
+		 */
+		double	oldest = W->readings[slot];
+		double	mean = W->mean[cell] + (reading - oldest) / W->windowSize;
+
+		W->sumOfSquaredDeviations[cell] = fmax(
+			W->sumOfSquaredDeviations[cell] + (reading - oldest) * (reading - mean + oldest - W->mean[cell]),
+			0);
+		W->mean[cell] = mean;
+		W->sumOfClippedAbsoluteDifferences[cell] -= W->clippedAbsoluteDifferences[slot];
+	}
+
+	W->sumOfClippedAbsoluteDifferences[cell] += absoluteDifference;
+	W->readings[slot] = reading;
+	W->clippedAbsoluteDifferences[slot] = absoluteDifference;
+	W->latest[cell] = reading;
+	W->numberOfReadings[cell] = n + 1;
+
+	return;
+}
+
+void
+noiseWindowsUpdateAll(NoiseWindows *  W, const double *  readings)
+{
+	for (size_t cell = 0; cell < W->numberOfCells; cell++)
+	{
+		noiseWindowUpdate(W, cell, readings[cell]);
+	}
+
+	return;
+}
+
+double
+noiseWindowMean(const NoiseWindows *  W, size_t cell)
+{
+	return W->mean[cell];
+}
+
+double
+noiseWindowStandardDeviation(const NoiseWindows *  W, size_t cell)
+{
+	uint64_t	n = W->numberOfReadings[cell];
+	size_t		count = (n < W->windowSize) ? n : W->windowSize;
+
+	return (count > 1) ? sqrt(W->sumOfSquaredDeviations[cell] / (count - 1)) : 0.0;
+}
+
+double
+noiseWindowRobustStandardDeviation(const NoiseWindows *  W, size_t cell)
+{
+	uint64_t	n = W->numberOfReadings[cell];
+	size_t		numberOfDifferences = (n == 0) ? 0 : ((n - 1 < W->windowSize) ? n - 1 : W->windowSize);
+
+	return (numberOfDifferences > 0) ?
+		kNoiseAbsoluteDifferenceToStandardDeviation * W->sumOfClippedAbsoluteDifferences[cell] / numberOfDifferences :
+		0.0;
+}
+
+double
+noiseWindowMeasuredVoltage(const NoiseWindows *  W, size_t cell)
+{
+	return UxHwDoubleGaussDist(W->latest[cell], noiseWindowRobustStandardDeviation(W, cell));
+}
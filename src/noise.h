@@ -0,0 +1,122 @@
+/*
+ *	Copyright (c) 2022-2024, Signaloid.
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in all
+ *	copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *	SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "common.h"
+
+/*
+ *	Sliding windows over the last `windowSize` voltage readings of every cell
+ *	in a fleet, stored as structure-of-arrays. The ring buffers are laid out
+ *	slot-major (`readings[slot * numberOfCells + cell]`), so updating every
+ *	cell once touches contiguous memory.
+ */
+typedef struct
+{
+	size_t		numberOfCells;
+	size_t		windowSize;
+	double *	readings;
+	double *	clippedAbsoluteDifferences;
+	double *	mean;
+	double *	sumOfSquaredDeviations;
+	double *	sumOfClippedAbsoluteDifferences;
+	double *	latest;
+	uint64_t *	numberOfReadings;
+} NoiseWindows;
+
+/**
+ *	@brief	Allocate empty noise windows.
+ *
+ *	@param	W		: Pointer to noise windows.
+ *	@param	numberOfCells	: Number of cells.
+ *	@param	windowSize	: Number of readings in each window; must be positive.
+ *	@return			: `kCommonConstantReturnTypeSuccess` if successful, else `kCommonConstantReturnTypeError`.
+ */
+CommonConstantReturnType	noiseWindowsInitialize(NoiseWindows *  W, size_t numberOfCells, size_t windowSize);
+
+/**
+ *	@brief	Free noise windows.
+ *
+ *	@param	W	: Pointer to noise windows.
+ */
+void	noiseWindowsFree(NoiseWindows *  W);
+
+/**
+ *	@brief	Add a reading to the window of one cell, evicting the oldest if full. O(1).
+ *
+ *	@param	W	: Pointer to noise windows.
+ *	@param	cell	: Index of the cell.
+ *	@param	reading	: Measured voltage.
+ */
+void	noiseWindowUpdate(NoiseWindows *  W, size_t cell, double reading);
+
+/**
+ *	@brief	Add one reading for every cell. O(1) per cell.
+ *
+ *	@param	W		: Pointer to noise windows.
+ *	@param	readings	: One measured voltage per cell.
+ */
+void	noiseWindowsUpdateAll(NoiseWindows *  W, const double *  readings);
+
+/**
+ *	@brief	Mean of the readings in the window of a cell.
+ *
+ *	@param	W	: Pointer to noise windows.
+ *	@param	cell	: Index of the cell.
+ *	@return		: Mean.
+ */
+double	noiseWindowMean(const NoiseWindows *  W, size_t cell);
+
+/**
+ *	@brief	Sample standard deviation of the readings in the window of a cell.
+ *
+ *	@param	W	: Pointer to noise windows.
+ *	@param	cell	: Index of the cell.
+ *	@return		: Standard deviation.
+ */
+double	noiseWindowStandardDeviation(const NoiseWindows *  W, size_t cell);
+
+/**
+ *	@brief	Robust estimate of the measurement noise standard deviation of a cell.
+ *
+ *		Computed from clipped absolute differences of successive readings, so
+ *		it is insensitive both to the slow discharge trend and to outliers.
+ *
+ *	@param	W	: Pointer to noise windows.
+ *	@param	cell	: Index of the cell.
+ *	@return		: Standard deviation.
+ */
+double	noiseWindowRobustStandardDeviation(const NoiseWindows *  W, size_t cell);
+
+/**
+ *	@brief	Measured voltage distribution of a cell: its latest reading with the noise of its window.
+ *
+ *		The result can be passed to `voltageToSoc` in place of `getDefaultMeasuredVoltage`.
+ *
+ *	@param	W	: Pointer to noise windows.
+ *	@param	cell	: Index of the cell.
+ *	@return		: Measured voltage distribution.
+ */
+double	noiseWindowMeasuredVoltage(const NoiseWindows *  W, size_t cell);
@@ -0,0 +1,373 @@
+/*
+ *	Copyright (c) 2022–2024, Signaloid.
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in all
+ *	copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *	SOFTWARE.
+ */
+
+
+#include "pack.h"
+#include "batt.h"
+#include "common.h"
+#include "counters.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <uxhw.h>
+
+
+/*
+ *	Defaults for generic Li-Ion (Panasonic CGR-17500), as in `batteryInitialize`.
+ */
+const double	kPackCellVoltageFull = 4.2;
+const double	kPackCellVoltageExpended = 2.0;
+const double	kPackCellCurrentLeak = 1E-6;
+
+/*
+ *	Sampled capacities and resistances are truncated at this fraction of their
+ *	nominal values, so that a Gaussian tail never yields a non-positive one.
+ */
+const double	kPackSampledMinimumFraction = 0.1;
+
+/*
+ *	`packSampleCutoffTimes` gives up on a pack after this multiple of the time
+ *	its largest parallel group would take to empty at the lowest pack current.
+ */
+const double	kPackCutoffTimeSafetyFactor = 2.0;
+
+CommonConstantReturnType
+packInitialize(Pack *  P, const PackParameters *  parameters)
+{
+	size_t		numberOfCells = parameters->numberOfCellsInSeries * parameters->numberOfCellsInParallel;
+	double **	arrays[] = {
+				&P->totalCapacity, &P->remainingCapacity, &P->soc, &P->voltageOffset,
+				&P->resistance, &P->voltageCell, &P->currentCell, &P->currentCellOld};
+
+	if (numberOfCells == 0)
+	{
+		fprintf(stderr, "Error: A pack needs at least one cell in series and one in parallel.\n");
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	if (!(parameters->capacityMilliAh > 0) || !(parameters->resistance > 0))
+	{
+		fprintf(stderr, "Error: The pack cell capacity and resistance must be positive.\n");
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	for (size_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++)
+	{
+		*arrays[i] = (double *) checkedMalloc(numberOfCells * sizeof(double), __FILE__, __LINE__);
+	}
+
+	P->numberOfCellsInSeries = parameters->numberOfCellsInSeries;
+	P->numberOfCellsInParallel = parameters->numberOfCellsInParallel;
+	P->numberOfCells = numberOfCells;
+	P->currentLeak = kPackCellCurrentLeak;
+	P->voltageBatteryExpended = kPackCellVoltageExpended;
+
+	for (size_t i = 0; i < numberOfCells; i++)
+	{
+		P->totalCapacity[i] = 3600 * parameters->capacityMilliAh / 1000;
+		P->voltageOffset[i] = 0.0;
+		P->resistance[i] = parameters->resistance;
+	}
+
+	packSetSoc(P, 1.0);
+
+	return kCommonConstantReturnTypeSuccess;
+}
+
+void
+packFree(Pack *  P)
+{
+	free(P->totalCapacity);
+	free(P->remainingCapacity);
+	free(P->soc);
+	free(P->voltageOffset);
+	free(P->resistance);
+	free(P->voltageCell);
+	free(P->currentCell);
+	free(P->currentCellOld);
+
+	return;
+}
+
+void
+packSampleVariability(Pack *  P, const PackParameters *  parameters)
+{
+	double	totalCapacity = 3600 * parameters->capacityMilliAh / 1000;
+
+	for (size_t i = 0; i < P->numberOfCells; i++)
+	{
+		P->totalCapacity[i] = fmax(
+						UxHwDoubleGaussDist(
+							totalCapacity,
+							totalCapacity * parameters->capacityRelativeStandardDeviation),
+						totalCapacity * kPackSampledMinimumFraction);
+		P->voltageOffset[i] = UxHwDoubleGaussDist(0.0, parameters->voltageOffsetStandardDeviation);
+		P->resistance[i] = fmax(
+						UxHwDoubleGaussDist(
+							parameters->resistance,
+							parameters->resistance * parameters->resistanceRelativeStandardDeviation),
+						parameters->resistance * kPackSampledMinimumFraction);
+		P->remainingCapacity[i] = P->soc[i] * P->totalCapacity[i];
+	}
+
+	return;
+}
+
+/**
+ *	@brief	Loaded terminal voltage of a parallel group.
+ *
+ *		Cells in a group share a terminal voltage, so each cell carries
+ *		`(voltageCell - voltageTerminal) / resistance` and the cell currents
+ *		sum to the pack current:
+ *
+ *			voltageTerminal = (sum(voltageCell / resistance) - current) / sum(1 / resistance)
+ *
+ *	@param	P	: Pointer to pack, with `voltageCell` set.
+ *	@param	first	: Index of the first cell of the group.
+ *	@param	current	: Pack current.
+ *	@return		: Terminal voltage.
+ */
+static double
+packGroupTerminalVoltage(const Pack *  P, size_t first, double current)
+{
+	double	conductanceSum = 0.0;
+	double	weightedVoltageSum = 0.0;
+
+	for (size_t i = first; i < first + P->numberOfCellsInParallel; i++)
+	{
+		conductanceSum += 1 / P->resistance[i];
+		weightedVoltageSum += P->voltageCell[i] / P->resistance[i];
+	}
+
+	return (weightedVoltageSum - current) / conductanceSum;
+}
+
+void
+packSetSoc(Pack *  P, double soc)
+{
+	double	voltage = socToVoltage(soc);
+
+	P->dead = 0;
+	P->timeNow = 0.0;
+	P->timeOld = 0.0;
+	P->current = 0.0;
+	P->voltagePack = 0.0;
+
+	for (size_t i = 0; i < P->numberOfCells; i++)
+	{
+		P->soc[i] = soc;
+		P->remainingCapacity[i] = soc * P->totalCapacity[i];
+		P->voltageCell[i] = voltage + P->voltageOffset[i];
+		P->currentCell[i] = 0.0;
+		P->currentCellOld[i] = 0.0;
+	}
+
+	/*
+	 *	As in `packUpdate`, at zero current.
+	 */
+	for (size_t s = 0; s < P->numberOfCells; s += P->numberOfCellsInParallel)
+	{
+		double	voltageTerminal = packGroupTerminalVoltage(P, s, 0.0);
+
+		P->voltagePack += voltageTerminal;
+		P->dead |= (voltageTerminal <= P->voltageBatteryExpended);
+	}
+
+	if (P->dead)
+	{
+		COUNTERS_INCREMENT(kCounterBatteryExpendedLatch);
+	}
+
+	return;
+}
+
+void
+packUpdate(Pack *  P, double timeNow, double powerLoad)
+{
+	size_t	numberOfCells = P->numberOfCells;
+	size_t	numberOfCellsInParallel = P->numberOfCellsInParallel;
+	double	timeStep;
+	double	voltagePack = 0.0;
+	int	dead = 0;
+
+	P->timeNow = timeNow;
+	if (P->dead)
+	{
+		return;
+	}
+
+	/*
+	 *	Pack current is given by energy conservation, as for a single cell in
+	 *	`batteryUpdate`. All parallel groups in the string carry this current.
+	 */
+	P->current = powerLoad / P->voltagePack;
+
+	/*
+	 *	Coulomb counting and discharge characteristic for every cell in one pass.
+	 */
+	timeStep = P->timeNow - P->timeOld;
+	for (size_t i = 0; i < numberOfCells; i++)
+	{
+		P->remainingCapacity[i] -= P->currentCellOld[i] * timeStep;
+		P->soc[i] = fmax(P->remainingCapacity[i] / P->totalCapacity[i], 0);
+		P->voltageCell[i] = socToVoltage(P->soc[i]) + P->voltageOffset[i];
+	}
+
+	for (size_t s = 0; s < numberOfCells; s += numberOfCellsInParallel)
+	{
+		double	voltageTerminal = packGroupTerminalVoltage(P, s, P->current);
+
+		voltagePack += voltageTerminal;
+
+		/*
+		 *	Cutoff is on the loaded terminal voltage, which includes the
+		 *	resistive drop, rather than on the open-circuit cell voltages.
+		 */
+		dead |= (voltageTerminal <= P->voltageBatteryExpended);
+
+		for (size_t i = s; i < s + numberOfCellsInParallel; i++)
+		{
+			P->currentCell[i] = (P->voltageCell[i] - voltageTerminal) / P->resistance[i] + P->currentLeak;
+		}
+	}
+
+	/*
+	 *	The pack is cut off as soon as its weakest parallel group is expended.
+	 */
+	if (dead)
+	{
+		COUNTERS_INCREMENT(kCounterBatteryExpendedLatch);
+	}
+	P->dead = dead;
+	P->voltagePack = voltagePack;
+	memcpy(P->currentCellOld, P->currentCell, numberOfCells * sizeof(double));
+	P->timeOld = P->timeNow;
+
+	return;
+}
+
+CommonConstantReturnType
+packSampleCutoffTimes(
+	const PackParameters *	parameters,
+	double			powerLoad,
+	double			timeStep,
+	size_t			numberOfPacks,
+	double *		cutoffTimes)
+{
+	Pack		sampled;
+	size_t		numberOfCells = parameters->numberOfCellsInSeries * parameters->numberOfCellsInParallel;
+	double *	totalCapacity;
+	double *	voltageOffset;
+	double *	resistance;
+
+	if (!(timeStep > 0))
+	{
+		fprintf(stderr, "Error: The pack timestep must be positive.\n");
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	if (!(powerLoad > 0))
+	{
+		fprintf(stderr, "Error: The pack load power must be positive.\n");
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	/*
+	 *	Draw the spread of every pack up front: the sampling routines share one
+	 *	random number generator, whereas the simulations below are independent.
+	 */
+	if (packInitialize(&sampled, parameters) != kCommonConstantReturnTypeSuccess)
+	{
+		return kCommonConstantReturnTypeError;
+	}
+
+	totalCapacity = (double *) checkedMalloc(numberOfPacks * numberOfCells * sizeof(double), __FILE__, __LINE__);
+	voltageOffset = (double *) checkedMalloc(numberOfPacks * numberOfCells * sizeof(double), __FILE__, __LINE__);
+	resistance = (double *) checkedMalloc(numberOfPacks * numberOfCells * sizeof(double), __FILE__, __LINE__);
+
+	for (size_t i = 0; i < numberOfPacks; i++)
+	{
+		packSampleVariability(&sampled, parameters);
+		memcpy(&totalCapacity[i * numberOfCells], sampled.totalCapacity, numberOfCells * sizeof(double));
+		memcpy(&voltageOffset[i * numberOfCells], sampled.voltageOffset, numberOfCells * sizeof(double));
+		memcpy(&resistance[i * numberOfCells], sampled.resistance, numberOfCells * sizeof(double));
+	}
+	packFree(&sampled);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+	for (size_t i = 0; i < numberOfPacks; i++)
+	{
+		Pack	P;
+		double	time = 0.0;
+		double	largestGroupCapacity = 0.0;
+		double	maxNumberOfSteps;
+		size_t	numberOfSteps = 0;
+
+		/*
+		 *	Cannot fail: the parameters were checked above.
+		 */
+		(void) packInitialize(&P, parameters);
+		memcpy(P.totalCapacity, &totalCapacity[i * numberOfCells], numberOfCells * sizeof(double));
+		memcpy(P.voltageOffset, &voltageOffset[i * numberOfCells], numberOfCells * sizeof(double));
+		memcpy(P.resistance, &resistance[i * numberOfCells], numberOfCells * sizeof(double));
+		packSetSoc(&P, 1.0);
+
+		/*
+		 *	The pack voltage only falls as the pack discharges, so the pack
+		 *	current never drops below `powerLoad / voltagePack` at full charge.
+		 */
+		for (size_t s = 0; s < numberOfCells; s += P.numberOfCellsInParallel)
+		{
+			double	groupCapacity = 0.0;
+
+			for (size_t j = s; j < s + P.numberOfCellsInParallel; j++)
+			{
+				groupCapacity += P.totalCapacity[j];
+			}
+			largestGroupCapacity = fmax(largestGroupCapacity, groupCapacity);
+		}
+		maxNumberOfSteps = ceil(kPackCutoffTimeSafetyFactor * largestGroupCapacity * P.voltagePack / powerLoad / timeStep);
+
+		while (!P.dead && (numberOfSteps < maxNumberOfSteps))
+		{
+			time += timeStep;
+			packUpdate(&P, time, powerLoad);
+			numberOfSteps++;
+		}
+
+		cutoffTimes[i] = P.dead ? time : INFINITY;
+		packFree(&P);
+	}
+
+	free(totalCapacity);
+	free(voltageOffset);
+	free(resistance);
+
+	return kCommonConstantReturnTypeSuccess;
+}
@@ -0,0 +1,129 @@
+/*
+ *	Copyright (c) 2022-2024, Signaloid.
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in all
+ *	copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *	SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <stddef.h>
+#include "common.h"
+
+typedef struct
+{
+	size_t	numberOfCellsInSeries;
+	size_t	numberOfCellsInParallel;
+	double	capacityMilliAh;
+	double	capacityRelativeStandardDeviation;
+	double	voltageOffsetStandardDeviation;
+	double	resistance;
+	double	resistanceRelativeStandardDeviation;
+} PackParameters;
+
+/*
+ *	Per-cell state is stored as structure-of-arrays. Cell `s * numberOfCellsInParallel + p`
+ *	is the `p`th cell of the `s`th parallel group in the series string.
+ */
+typedef struct
+{
+	int	dead;
+	size_t	numberOfCellsInSeries;
+	size_t	numberOfCellsInParallel;
+	size_t	numberOfCells;
+	double	currentLeak;
+	double	current;
+	double	voltagePack;
+	double	voltageBatteryExpended;
+	double	timeNow;
+	double	timeOld;
+	double *	totalCapacity;
+	double *	remainingCapacity;
+	double *	soc;
+	double *	voltageOffset;
+	double *	resistance;
+	double *	voltageCell;
+	double *	currentCell;
+	double *	currentCellOld;
+} Pack;
+
+/**
+ *	@brief	Allocate a pack of identical cells at 100% state of charge.
+ *
+ *	@param	P		: Pointer to pack.
+ *	@param	parameters	: Pack topology and nominal cell parameters; the capacity and resistance must be positive.
+ *	@return			: `kCommonConstantReturnTypeSuccess` if successful, else `kCommonConstantReturnTypeError`.
+ */
+CommonConstantReturnType	packInitialize(Pack *  P, const PackParameters *  parameters);
+
+/**
+ *	@brief	Free the per-cell arrays of a pack.
+ *
+ *	@param	P	: Pointer to pack.
+ */
+void	packFree(Pack *  P);
+
+/**
+ *	@brief	Draw per-cell capacity, curve offset and resistance from their manufacturing spread.
+ *
+ *		Capacity and resistance are truncated at `kPackSampledMinimumFraction` of nominal.
+ *
+ *	@param	P		: Pointer to pack.
+ *	@param	parameters	: Nominal cell parameters and their spread.
+ */
+void	packSampleVariability(Pack *  P, const PackParameters *  parameters);
+
+/**
+ *	@brief	Set the state of charge of every cell in the pack, and the pack voltage at zero current.
+ *
+ *	@param	P	: Pointer to pack.
+ *	@param	soc	: State of charge.
+ */
+void	packSetSoc(Pack *  P, double soc);
+
+/**
+ *	@brief	Update pack. The per-cell step follows `batteryUpdate`; the pack is cut off
+ *		when the loaded terminal voltage of any parallel group reaches `voltageBatteryExpended`.
+ *
+ *	@param	P		: Pointer to pack.
+ *	@param	timeNow		: Current time.
+ *	@param	powerLoad	: Power drawn by the load (W).
+ */
+void	packUpdate(Pack *  P, double timeNow, double powerLoad);
+
+/**
+ *	@brief	Sample pack cutoff times over many packs with independent cell-to-cell spread.
+ *
+ *		Packs are simulated in parallel when built with OpenMP.
+ *
+ *	@param	parameters	: Pack topology, nominal cell parameters and their spread.
+ *	@param	powerLoad	: Power drawn by the load (W); must be positive.
+ *	@param	timeStep	: Timestep of `packUpdate`; must be positive.
+ *	@param	numberOfPacks	: Number of packs to sample.
+ *	@param	cutoffTimes	: Receives `numberOfPacks` cutoff times (s), `INFINITY` for packs still
+ *				  above cutoff after twice the time their largest parallel group would
+ *				  take to empty at the pack current at full charge.
+ *	@return			: `kCommonConstantReturnTypeSuccess` if successful, else `kCommonConstantReturnTypeError`.
+ */
+CommonConstantReturnType	packSampleCutoffTimes(
+					const PackParameters *	parameters,
+					double			powerLoad,
+					double			timeStep,
+					size_t			numberOfPacks,
+					double *		cutoffTimes);
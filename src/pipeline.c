@@ -0,0 +1,477 @@
+/*
+ *	Copyright (c) 2022–2024, Signaloid.
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in all
+ *	copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *	SOFTWARE.
+ */
+
+
+#include "pipeline.h"
+#include "common.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+#define	kPipelineBatchSize		(1024)
+#define	kPipelineQueueCapacity		(8)
+#define	kPipelineCacheLineSize		(64)
+#define	kPipelineMaxCharsPerLine	(256)
+
+typedef struct
+{
+	size_t	numberOfRecords;
+	int	isLast;
+	double	records[kPipelineBatchSize];
+} PipelineBatch;
+
+/*
+ *	Single-producer/single-consumer ring buffer of batches. The producer fills
+ *	the slot at `tail` in place and publishes it by advancing `tail`; the
+ *	consumer reads the slot at `head` and frees it by advancing `head`.
+ */
+typedef struct
+{
+	_Alignas(kPipelineCacheLineSize) atomic_size_t	head;
+	_Alignas(kPipelineCacheLineSize) atomic_size_t	tail;
+	PipelineBatch					slots[kPipelineQueueCapacity];
+} PipelineQueue;
+
+typedef struct
+{
+	FILE *			input;
+	FILE *			output;
+	double			(*estimator)(double);
+	size_t			numberOfWorkers;
+	PipelineQueue *		toWorkers;
+	PipelineQueue *		fromWorkers;
+	PipelineStageStatistics	reader;
+	PipelineStageStatistics	writer;
+	int			isWriteFailed;
+	size_t			invalidLineNumber;
+	atomic_int		isAborted;
+} Pipeline;
+
+typedef struct
+{
+	Pipeline *		pipeline;
+	size_t			index;
+	PipelineStageStatistics	statistics;
+} PipelineWorker;
+
+/**
+ *	@brief	Allocate queues on cache-line boundaries, as their `_Alignas` members require.
+ *
+ *	@param	numberOfQueues	: Number of queues.
+ *	@return			: Queues, or `NULL` if the allocation failed.
+ */
+static PipelineQueue *
+pipelineQueuesAllocate(size_t numberOfQueues)
+{
+	size_t	size = numberOfQueues * sizeof(PipelineQueue);
+
+	/*
+	 *	`aligned_alloc` needs a size that is a multiple of the alignment.
+	 */
+	size = (size + kPipelineCacheLineSize - 1) / kPipelineCacheLineSize * kPipelineCacheLineSize;
+
+	return (PipelineQueue *) aligned_alloc(kPipelineCacheLineSize, size);
+}
+
+static double
+monotonicSeconds(void)
+{
+	struct timespec	now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + now.tv_nsec / 1E9;
+}
+
+/*
+ *	The blocking queue operations return `NULL` once the pipeline is aborted,
+ *	so that no stage waits forever on a stage that was never started.
+ */
+static PipelineBatch *
+pipelineQueueReserve(Pipeline *  pipeline, PipelineQueue *  queue, PipelineStageStatistics *  statistics)
+{
+	size_t	tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+	double	start = monotonicSeconds();
+
+	while (tail - atomic_load_explicit(&queue->head, memory_order_acquire) == kPipelineQueueCapacity)
+	{
+		if (atomic_load_explicit(&pipeline->isAborted, memory_order_relaxed))
+		{
+			return NULL;
+		}
+		sched_yield();
+	}
+	statistics->blockedSeconds += monotonicSeconds() - start;
+
+	return &queue->slots[tail % kPipelineQueueCapacity];
+}
+
+static void
+pipelineQueuePublish(PipelineQueue *  queue)
+{
+	atomic_store_explicit(
+		&queue->tail,
+		atomic_load_explicit(&queue->tail, memory_order_relaxed) + 1,
+		memory_order_release);
+
+	return;
+}
+
+static PipelineBatch *
+pipelineQueuePeek(Pipeline *  pipeline, PipelineQueue *  queue, PipelineStageStatistics *  statistics)
+{
+	size_t	head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+	double	start = monotonicSeconds();
+
+	while (atomic_load_explicit(&queue->tail, memory_order_acquire) == head)
+	{
+		if (atomic_load_explicit(&pipeline->isAborted, memory_order_relaxed))
+		{
+			return NULL;
+		}
+		sched_yield();
+	}
+	statistics->blockedSeconds += monotonicSeconds() - start;
+
+	return &queue->slots[head % kPipelineQueueCapacity];
+}
+
+static void
+pipelineQueueRelease(PipelineQueue *  queue)
+{
+	atomic_store_explicit(
+		&queue->head,
+		atomic_load_explicit(&queue->head, memory_order_relaxed) + 1,
+		memory_order_release);
+
+	return;
+}
+
+/*
+ *	Batches are dealt to the workers round-robin and collected by the writer
+ *	in the same order, so every queue stays single-producer/single-consumer
+ *	and the output order matches the input order.
+ */
+static void *
+pipelineReader(void *  argument)
+{
+	Pipeline *	pipeline = (Pipeline *) argument;
+	char		line[kPipelineMaxCharsPerLine];
+	size_t		next = 0;
+	size_t		lineNumber = 0;
+	int		isEndOfInput = 0;
+
+	while (!isEndOfInput)
+	{
+		PipelineBatch *	batch = pipelineQueueReserve(pipeline, &pipeline->toWorkers[next], &pipeline->reader);
+		double		start = monotonicSeconds();
+
+		if (batch == NULL)
+		{
+			return NULL;
+		}
+
+		batch->numberOfRecords = 0;
+		while (batch->numberOfRecords < kPipelineBatchSize)
+		{
+			char *	end;
+			double	value;
+
+			if (fgets(line, sizeof(line), pipeline->input) == NULL)
+			{
+				isEndOfInput = 1;
+
+				break;
+			}
+			lineNumber++;
+
+			/*
+			 *	Every input line gets an output line, so a line that is not a
+			 *	voltage ends the input here and fails the run once the lines
+			 *	before it have been written.
+			 */
+			value = strtod(line, &end);
+			if ((end == line) || (end[strspn(end, " \t\r\n")] != '\0'))
+			{
+				pipeline->invalidLineNumber = lineNumber;
+				isEndOfInput = 1;
+
+				break;
+			}
+			batch->records[batch->numberOfRecords++] = value;
+		}
+		batch->isLast = 0;
+
+		pipeline->reader.busySeconds += monotonicSeconds() - start;
+		pipeline->reader.numberOfRecords += batch->numberOfRecords;
+		pipeline->reader.numberOfBatches++;
+		pipelineQueuePublish(&pipeline->toWorkers[next]);
+		next = (next + 1) % pipeline->numberOfWorkers;
+	}
+
+	/*
+	 *	Tell every worker that the stream has ended.
+	 */
+	for (size_t i = 0; i < pipeline->numberOfWorkers; i++)
+	{
+		PipelineBatch *	batch = pipelineQueueReserve(pipeline, &pipeline->toWorkers[next], &pipeline->reader);
+
+		if (batch == NULL)
+		{
+			return NULL;
+		}
+
+		batch->numberOfRecords = 0;
+		batch->isLast = 1;
+		pipelineQueuePublish(&pipeline->toWorkers[next]);
+		next = (next + 1) % pipeline->numberOfWorkers;
+	}
+
+	return NULL;
+}
+
+static void *
+pipelineWorker(void *  argument)
+{
+	PipelineWorker *	worker = (PipelineWorker *) argument;
+	Pipeline *		pipeline = worker->pipeline;
+	PipelineQueue *		in = &pipeline->toWorkers[worker->index];
+	PipelineQueue *		out = &pipeline->fromWorkers[worker->index];
+	int			isLast = 0;
+
+	while (!isLast)
+	{
+		PipelineBatch *	source = pipelineQueuePeek(pipeline, in, &worker->statistics);
+		PipelineBatch *	destination = (source != NULL) ? pipelineQueueReserve(pipeline, out, &worker->statistics) : NULL;
+		double		start = monotonicSeconds();
+
+		if (destination == NULL)
+		{
+			return NULL;
+		}
+
+		for (size_t i = 0; i < source->numberOfRecords; i++)
+		{
+			destination->records[i] = pipeline->estimator(source->records[i]);
+		}
+		destination->numberOfRecords = source->numberOfRecords;
+		destination->isLast = isLast = source->isLast;
+
+		worker->statistics.busySeconds += monotonicSeconds() - start;
+		worker->statistics.numberOfRecords += source->numberOfRecords;
+		worker->statistics.numberOfBatches += !isLast;
+		pipelineQueueRelease(in);
+		pipelineQueuePublish(out);
+	}
+
+	return NULL;
+}
+
+static void *
+pipelineWriter(void *  argument)
+{
+	Pipeline *	pipeline = (Pipeline *) argument;
+	size_t		numberOfFinishedWorkers = 0;
+
+	for (size_t next = 0; numberOfFinishedWorkers < pipeline->numberOfWorkers; next = (next + 1) % pipeline->numberOfWorkers)
+	{
+		PipelineBatch *	batch = pipelineQueuePeek(pipeline, &pipeline->fromWorkers[next], &pipeline->writer);
+		double		start = monotonicSeconds();
+
+		if (batch == NULL)
+		{
+			return NULL;
+		}
+
+		for (size_t i = 0; i < batch->numberOfRecords; i++)
+		{
+			if (fprintf(pipeline->output, "%lf\n", batch->records[i]) < 0)
+			{
+				pipeline->isWriteFailed = 1;
+			}
+		}
+
+		numberOfFinishedWorkers += batch->isLast;
+		pipeline->writer.busySeconds += monotonicSeconds() - start;
+		pipeline->writer.numberOfRecords += batch->numberOfRecords;
+		pipeline->writer.numberOfBatches += !batch->isLast;
+		pipelineQueueRelease(&pipeline->fromWorkers[next]);
+	}
+
+	return NULL;
+}
+
+CommonConstantReturnType
+pipelineRun(
+	FILE *			input,
+	FILE *			output,
+	double			(*estimator)(double),
+	size_t			numberOfWorkers,
+	PipelineStatistics *	statistics)
+{
+	Pipeline		pipeline = {0};
+	PipelineWorker *	workers;
+	pthread_t *		workerThreads;
+	pthread_t		readerThread;
+	pthread_t		writerThread;
+	size_t			numberOfWorkerThreads;
+	int			isReaderCreated;
+	int			isWriterCreated;
+
+	if (numberOfWorkers == 0)
+	{
+		fprintf(stderr, "Error: The pipeline needs at least one worker.\n");
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	pipeline.input = input;
+	pipeline.output = output;
+	pipeline.estimator = estimator;
+	pipeline.numberOfWorkers = numberOfWorkers;
+	pipeline.toWorkers = pipelineQueuesAllocate(numberOfWorkers);
+	pipeline.fromWorkers = pipelineQueuesAllocate(numberOfWorkers);
+	if ((pipeline.toWorkers == NULL) || (pipeline.fromWorkers == NULL))
+	{
+		fprintf(stderr, "Error: Could not allocate the pipeline queues.\n");
+		free(pipeline.toWorkers);
+		free(pipeline.fromWorkers);
+
+		return kCommonConstantReturnTypeError;
+	}
+	workers = (PipelineWorker *) checkedMalloc(numberOfWorkers * sizeof(PipelineWorker), __FILE__, __LINE__);
+	workerThreads = (pthread_t *) checkedMalloc(numberOfWorkers * sizeof(pthread_t), __FILE__, __LINE__);
+
+	for (size_t i = 0; i < numberOfWorkers; i++)
+	{
+		atomic_init(&pipeline.toWorkers[i].head, 0);
+		atomic_init(&pipeline.toWorkers[i].tail, 0);
+		atomic_init(&pipeline.fromWorkers[i].head, 0);
+		atomic_init(&pipeline.fromWorkers[i].tail, 0);
+		workers[i] = (PipelineWorker) { .pipeline = &pipeline, .index = i };
+	}
+
+	atomic_init(&pipeline.isAborted, 0);
+
+	isReaderCreated = (pthread_create(&readerThread, NULL, pipelineReader, &pipeline) == 0);
+	for (numberOfWorkerThreads = 0; isReaderCreated && (numberOfWorkerThreads < numberOfWorkers); numberOfWorkerThreads++)
+	{
+		if (pthread_create(&workerThreads[numberOfWorkerThreads], NULL, pipelineWorker, &workers[numberOfWorkerThreads]) != 0)
+		{
+			break;
+		}
+	}
+	isWriterCreated = (numberOfWorkerThreads == numberOfWorkers) && (pthread_create(&writerThread, NULL, pipelineWriter, &pipeline) == 0);
+
+	/*
+	 *	If any stage could not be started, the stages that were would block on
+	 *	its queues forever; abort them instead.
+	 */
+	if (!isWriterCreated)
+	{
+		atomic_store(&pipeline.isAborted, 1);
+	}
+
+	if (isReaderCreated)
+	{
+		pthread_join(readerThread, NULL);
+	}
+	for (size_t i = 0; i < numberOfWorkerThreads; i++)
+	{
+		pthread_join(workerThreads[i], NULL);
+	}
+	if (isWriterCreated)
+	{
+		pthread_join(writerThread, NULL);
+	}
+
+	if (statistics != NULL)
+	{
+		*statistics = (PipelineStatistics) { .numberOfWorkers = numberOfWorkers };
+		statistics->stages[kPipelineStageReader] = pipeline.reader;
+		statistics->stages[kPipelineStageWriter] = pipeline.writer;
+		for (size_t i = 0; i < numberOfWorkers; i++)
+		{
+			statistics->stages[kPipelineStageWorker].numberOfBatches += workers[i].statistics.numberOfBatches;
+			statistics->stages[kPipelineStageWorker].numberOfRecords += workers[i].statistics.numberOfRecords;
+			statistics->stages[kPipelineStageWorker].busySeconds += workers[i].statistics.busySeconds;
+			statistics->stages[kPipelineStageWorker].blockedSeconds += workers[i].statistics.blockedSeconds;
+		}
+	}
+
+	free(pipeline.toWorkers);
+	free(pipeline.fromWorkers);
+	free(workers);
+	free(workerThreads);
+
+	if (!isWriterCreated)
+	{
+		fprintf(stderr, "Error: Could not start the pipeline threads.\n");
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	if (pipeline.invalidLineNumber != 0)
+	{
+		fprintf(stderr, "Error: Line %zu of the input is not a voltage.\n", pipeline.invalidLineNumber);
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	if (pipeline.isWriteFailed)
+	{
+		fprintf(stderr, "Error: Could not write pipeline output.\n");
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	return kCommonConstantReturnTypeSuccess;
+}
+
+void
+pipelinePrintStatistics(FILE *  stream, const PipelineStatistics *  statistics)
+{
+	const char *	stageNames[kPipelineStageMax] = {"reader", "worker", "writer"};
+
+	fprintf(stream, "Pipeline stage utilization (%zu workers):\n", statistics->numberOfWorkers);
+	for (PipelineStage stage = 0; stage < kPipelineStageMax; stage++)
+	{
+		const PipelineStageStatistics *	s = &statistics->stages[stage];
+		double				total = s->busySeconds + s->blockedSeconds;
+
+		fprintf(
+			stream,
+			"\t%s: %" PRIu64 " records in %" PRIu64 " batches, busy %lf s, blocked %lf s, utilization %.1lf%%\n",
+			stageNames[stage],
+			s->numberOfRecords,
+			s->numberOfBatches,
+			s->busySeconds,
+			s->blockedSeconds,
+			(total > 0) ? 100 * s->busySeconds / total : 0.0);
+	}
+
+	return;
+}
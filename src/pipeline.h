@@ -0,0 +1,85 @@
+/*
+ *	Copyright (c) 2022-2024, Signaloid.
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in all
+ *	copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *	SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "common.h"
+
+typedef enum
+{
+	kPipelineStageReader	= 0,
+	kPipelineStageWorker,
+	kPipelineStageWriter,
+	kPipelineStageMax,
+} PipelineStage;
+
+typedef struct
+{
+	uint64_t	numberOfBatches;
+	uint64_t	numberOfRecords;
+	double		busySeconds;
+	double		blockedSeconds;
+} PipelineStageStatistics;
+
+typedef struct
+{
+	/*
+	 *	Worker statistics are summed over all workers.
+	 */
+	PipelineStageStatistics	stages[kPipelineStageMax];
+	size_t			numberOfWorkers;
+} PipelineStatistics;
+
+/**
+ *	@brief	Run the reader -> estimator -> writer pipeline over a stream of measured voltages.
+ *
+ *		The reader parses one voltage per line of `input` (lines that do not
+ *		parse, e.g., a CSV header, are skipped), `numberOfWorkers` workers apply
+ *		`estimator` to batches of records, and the writer prints one estimate per
+ *		line to `output` in input order. Stages are connected by bounded
+ *		single-producer/single-consumer ring buffers; a full buffer stalls its producer.
+ *
+ *	@param	input		: Input stream.
+ *	@param	output		: Output stream.
+ *	@param	estimator	: Function applied to every record, e.g., `voltageToSoc`.
+ *	@param	numberOfWorkers	: Number of estimator threads.
+ *	@param	statistics	: If not `NULL`, receives per-stage utilization counters.
+ *	@return			: `kCommonConstantReturnTypeSuccess` if successful, else `kCommonConstantReturnTypeError`.
+ */
+CommonConstantReturnType	pipelineRun(
+					FILE *			input,
+					FILE *			output,
+					double			(*estimator)(double),
+					size_t			numberOfWorkers,
+					PipelineStatistics *	statistics);
+
+/**
+ *	@brief	Print per-stage utilization counters.
+ *
+ *	@param	stream		: Output stream.
+ *	@param	statistics	: Statistics from `pipelineRun`.
+ */
+void	pipelinePrintStatistics(FILE *  stream, const PipelineStatistics *  statistics);
@@ -0,0 +1,116 @@
+/*
+ *	Copyright (c) 2022–2024, Signaloid.
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in all
+ *	copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *	SOFTWARE.
+ */
+
+
+#include "route.h"
+#include "batt.h"
+#include "common.h"
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/*
+ *	Number of state of charge quantiles used to represent the available energy.
+ */
+#define	kRouteEnergyQuantiles	(64)
+
+static int
+compareDoubles(const void *  a, const void *  b)
+{
+	double	x = *(const double *) a;
+	double	y = *(const double *) b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ *	Most likely route first; ties go to the cheaper route.
+ */
+static int
+compareRoutes(const void *  a, const void *  b)
+{
+	const Route *	x = (const Route *) a;
+	const Route *	y = (const Route *) b;
+
+	if (x->probabilityOfReachingHome != y->probabilityOfReachingHome)
+	{
+		return (x->probabilityOfReachingHome < y->probabilityOfReachingHome) ? 1 : -1;
+	}
+
+	return compareDoubles(&x->energyMean, &y->energyMean);
+}
+
+void
+routesRankByProbabilityOfReachingHome(
+	const Batt *	B,
+	const double *	socSamples,
+	size_t		numberOfSocSamples,
+	Route *		routes,
+	size_t		numberOfRoutes)
+{
+	double		energyQuantiles[kRouteEnergyQuantiles];
+	size_t		numberOfQuantiles = (numberOfSocSamples < kRouteEnergyQuantiles) ? numberOfSocSamples : kRouteEnergyQuantiles;
+	double		socCutoff = batteryCutoffSoc(B);
+	double *	sortedSocSamples;
+
+	/*
+	 *	The available energy is monotone in state of charge, so its quantiles
+	 *	are the energies at the state of charge quantiles. The caller's samples
+	 *	are left as they are; a copy (with one spare entry, so that it is never
+	 *	empty) is sorted.
+	 */
+	sortedSocSamples = (double *) checkedMalloc((numberOfSocSamples + 1) * sizeof(double), __FILE__, __LINE__);
+	memcpy(sortedSocSamples, socSamples, numberOfSocSamples * sizeof(double));
+	qsort(sortedSocSamples, numberOfSocSamples, sizeof(double), compareDoubles);
+	for (size_t k = 0; k < numberOfQuantiles; k++)
+	{
+		size_t	sample = (size_t) (((double) k + 0.5) * numberOfSocSamples / numberOfQuantiles);
+
+		energyQuantiles[k] = batteryEnergyToCutoff(B, sortedSocSamples[sample], socCutoff);
+	}
+	free(sortedSocSamples);
+
+	/*
+	 *	For each route, P(energy > cost) = mean over quantiles of Phi((energy - costMean) / costStandardDeviation).
+	 */
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+	for (size_t i = 0; i < numberOfRoutes; i++)
+	{
+		double	scale = 1 / (fmax(routes[i].energyStandardDeviation, DBL_MIN) * M_SQRT2);
+		double	probability = 0.0;
+
+		for (size_t k = 0; k < numberOfQuantiles; k++)
+		{
+			probability += erfc((routes[i].energyMean - energyQuantiles[k]) * scale);
+		}
+
+		routes[i].probabilityOfReachingHome = (numberOfQuantiles > 0) ? probability / (2 * numberOfQuantiles) : 0.0;
+	}
+
+	qsort(routes, numberOfRoutes, sizeof(Route), compareRoutes);
+
+	return;
+}
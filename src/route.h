@@ -0,0 +1,56 @@
+/*
+ *	Copyright (c) 2022-2024, Signaloid.
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in all
+ *	copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *	SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <stddef.h>
+#include "batt.h"
+
+typedef struct
+{
+	size_t	index;
+	double	energyMean;
+	double	energyStandardDeviation;
+	double	probabilityOfReachingHome;
+} Route;
+
+/**
+ *	@brief	Probability of reaching home above the cutoff voltage for every candidate route,
+ *		ranked from most to least likely.
+ *
+ *		The state of charge distribution is summarized by a fixed number of its
+ *		quantiles, so the cost per route does not depend on `numberOfSocSamples`.
+ *		Routes are evaluated in parallel when built with OpenMP.
+ *
+ *	@param	B			: Pointer to battery (capacity and cutoff voltage).
+ *	@param	socSamples		: Samples of the state of charge in [0.0 - 1.0], e.g., from `voltageToSoc` / 100 or `Batt.soc`.
+ *	@param	numberOfSocSamples	: Number of entries in `socSamples`.
+ *	@param	routes			: Candidate routes with Gaussian energy cost (J). On return, sorted by `probabilityOfReachingHome`.
+ *	@param	numberOfRoutes		: Number of entries in `routes`.
+ */
+void	routesRankByProbabilityOfReachingHome(
+		const Batt *	B,
+		const double *	socSamples,
+		size_t		numberOfSocSamples,
+		Route *		routes,
+		size_t		numberOfRoutes);
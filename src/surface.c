@@ -0,0 +1,597 @@
+/*
+ *	Copyright (c) 2022–2024, Signaloid.
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in all
+ *	copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *	SOFTWARE.
+ */
+
+
+#include "surface.h"
+#include "batt.h"
+#include "common.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define	kSurfaceInverseTableSize	(256)
+#define	kSurfaceMaxCharsPerToken	(64)
+
+/*
+ *	Upper bound on the number of cells in the index of an axis.
+ */
+#define	kSurfaceMaxAxisMapSize		(65536)
+
+/*
+ *	Upper bound on the number of tabulated voltages, so that offsets into
+ *	`voltage` and `inverseSoc` fit in the 32-bit indices the evaluators use.
+ */
+#define	kSurfaceMaxNumberOfVoltages	(INT32_MAX / kSurfaceInverseTableSize)
+
+/*
+ *	Conditions of the single slice built by `surfaceInitializeFromCurve`.
+ */
+const double	kSurfaceDefaultTemperature = 25.0;
+const double	kSurfaceDefaultCRate = 0.0;
+
+/**
+ *	@brief	Clamp a value to an interval, mapping NaN to `low` as `fmin(fmax(x, low), high)` does.
+ *
+ *		Written as selects rather than with `fmin` and `fmax`, which are library
+ *		calls unless NaNs are ruled out, so that it compiles to min and max instructions.
+ *
+ *	@param	x	: Value.
+ *	@param	low	: Lower end.
+ *	@param	high	: Upper end.
+ *	@return		: Clamped value.
+ */
+static inline double
+surfaceClamp(double x, double low, double high)
+{
+	x = (x > low) ? x : low;
+
+	return (x < high) ? x : high;
+}
+
+/**
+ *	@brief	Find the grid cell of an axis containing a point.
+ *
+ *		The index gives the grid interval at the start of the cell of the
+ *		point, and one comparison on either side corrects it, so there are no
+ *		branches. Points outside the axis are clamped to its ends.
+ *
+ *	@param	axis	: Pointer to axis.
+ *	@param	x	: Point.
+ *	@param	weight	: Receives the interpolation weight of the upper grid point.
+ *	@return		: Index of the lower grid point.
+ */
+static inline int32_t
+surfaceAxisLocate(const SurfaceAxis *  axis, double x, double *  weight)
+{
+	double	first = axis->values[0];
+	int32_t	cell;
+	int32_t	low;
+
+	x = surfaceClamp(x, first, axis->values[axis->length - 1]);
+	cell = (int32_t) surfaceClamp((x - first) * axis->mapScale, 0, axis->mapSize - 1);
+	low = axis->map[cell];
+	low -= (x < axis->values[low]);
+	low += (x >= axis->intervalEnd[low]);
+	*weight = (x - axis->values[low]) * axis->intervalInverseWidth[low];
+
+	return low;
+}
+
+/**
+ *	@brief	Build the index of an axis for `surfaceAxisLocate`.
+ *
+ *		The cells are at most half the smallest grid spacing wide, so that,
+ *		allowing for rounding, the interval of a point is that at the start
+ *		of its cell or one of its neighbours. A single-point axis has one
+ *		interval of zero weight that extends to infinity.
+ *
+ *	@param	axis	: Pointer to axis, with `length` and `values` set.
+ *	@return		: `false` if the axis needs more than `kSurfaceMaxAxisMapSize` cells.
+ */
+static bool
+surfaceAxisBuildIndex(SurfaceAxis *  axis)
+{
+	size_t	numberOfIntervals = (axis->length > 1) ? axis->length - 1 : 1;
+	double	first = axis->values[0];
+	double	range = axis->values[axis->length - 1] - first;
+	double	minimumSpacing = range;
+	double	mapSize = 1;
+	size_t	interval = 0;
+
+	for (size_t i = 1; i < axis->length; i++)
+	{
+		minimumSpacing = fmin(minimumSpacing, axis->values[i] - axis->values[i - 1]);
+	}
+
+	if (axis->length > 1)
+	{
+		mapSize = 2 * ceil(range / minimumSpacing);
+		if (!(mapSize <= kSurfaceMaxAxisMapSize))
+		{
+			return false;
+		}
+	}
+
+	axis->mapSize = (size_t) mapSize;
+	axis->mapScale = (axis->length > 1) ? mapSize / range : 0.0;
+	axis->map = (int32_t *) checkedMalloc(axis->mapSize * sizeof(int32_t), __FILE__, __LINE__);
+	axis->intervalEnd = (double *) checkedMalloc(numberOfIntervals * sizeof(double), __FILE__, __LINE__);
+	axis->intervalInverseWidth = (double *) checkedMalloc(numberOfIntervals * sizeof(double), __FILE__, __LINE__);
+
+	for (size_t i = 0; i < numberOfIntervals; i++)
+	{
+		double	end = (axis->length > 1) ? axis->values[i + 1] : first;
+
+		axis->intervalEnd[i] = (i + 1 < numberOfIntervals) ? end : INFINITY;
+		axis->intervalInverseWidth[i] = (axis->length > 1) ? 1 / (end - axis->values[i]) : 0.0;
+	}
+
+	for (size_t cell = 0; cell < axis->mapSize; cell++)
+	{
+		double	cellStart = first + cell * range / mapSize;
+
+		while ((interval + 1 < numberOfIntervals) && (axis->values[interval + 1] <= cellStart))
+		{
+			interval++;
+		}
+		axis->map[cell] = (int32_t) interval;
+	}
+
+	return true;
+}
+
+static void
+surfaceAxisFree(SurfaceAxis *  axis)
+{
+	free(axis->values);
+	free(axis->map);
+	free(axis->intervalEnd);
+	free(axis->intervalInverseWidth);
+
+	return;
+}
+
+/**
+ *	@brief	Build the monotone inverse table of every (temperature, C-rate) slice.
+ *
+ *		A slice that is not monotone in state of charge (e.g., from measurement
+ *		noise) is made so by its running maximum before being inverted.
+ *
+ *	@param	S	: Pointer to surface.
+ */
+static void
+surfaceBuildInverseTables(Surface *  S)
+{
+	size_t		numberOfSlices = S->temperature.length * S->cRate.length;
+	size_t		numberOfSocPoints = S->soc.length;
+	double *	monotone = (double *) checkedMalloc(numberOfSocPoints * sizeof(double), __FILE__, __LINE__);
+
+	S->inverseVoltageMin = (double *) checkedMalloc(numberOfSlices * sizeof(double), __FILE__, __LINE__);
+	S->inverseVoltageScale = (double *) checkedMalloc(numberOfSlices * sizeof(double), __FILE__, __LINE__);
+	S->inverseSoc = (double *) checkedMalloc(numberOfSlices * kSurfaceInverseTableSize * sizeof(double), __FILE__, __LINE__);
+
+	for (size_t slice = 0; slice < numberOfSlices; slice++)
+	{
+		const double *	voltage = &S->voltage[slice * numberOfSocPoints];
+		double *	inverseSoc = &S->inverseSoc[slice * kSurfaceInverseTableSize];
+		double		step;
+		size_t		i = 0;
+
+		monotone[0] = voltage[0];
+		for (size_t j = 1; j < numberOfSocPoints; j++)
+		{
+			monotone[j] = fmax(voltage[j], monotone[j - 1]);
+		}
+
+		step = (monotone[numberOfSocPoints - 1] - monotone[0]) / (kSurfaceInverseTableSize - 1);
+		S->inverseVoltageMin[slice] = monotone[0];
+		S->inverseVoltageScale[slice] = (step > 0) ? 1 / step : 0.0;
+
+		for (size_t k = 0; k < kSurfaceInverseTableSize; k++)
+		{
+			double	target = monotone[0] + k * step;
+			double	span;
+
+			while ((i < numberOfSocPoints - 2) && (monotone[i + 1] < target))
+			{
+				i++;
+			}
+
+			span = monotone[i + 1] - monotone[i];
+			inverseSoc[k] = S->soc.values[i] + ((span > 0) ?
+						fmin(fmax((target - monotone[i]) / span, 0), 1) * (S->soc.values[i + 1] - S->soc.values[i]) :
+						0.0);
+		}
+	}
+
+	free(monotone);
+
+	return;
+}
+
+/**
+ *	@brief	Read the next whitespace-separated token, skipping `#` comments.
+ *
+ *	@param	file	: Input file.
+ *	@param	token	: Receives the token (at least `kSurfaceMaxCharsPerToken` chars).
+ *	@return		: `true` if a token was read.
+ */
+static bool
+surfaceReadToken(FILE *  file, char *  token)
+{
+	while (fscanf(file, "%63s", token) == 1)
+	{
+		int	c;
+
+		if (token[0] != '#')
+		{
+			return true;
+		}
+
+		do
+		{
+			c = fgetc(file);
+		} while ((c != '\n') && (c != EOF));
+	}
+
+	return false;
+}
+
+static bool
+surfaceReadDouble(FILE *  file, double *  value)
+{
+	char	token[kSurfaceMaxCharsPerToken];
+	char *	end;
+
+	if (!surfaceReadToken(file, token))
+	{
+		return false;
+	}
+	*value = strtod(token, &end);
+
+	return (end != token) && (*end == '\0');
+}
+
+/**
+ *	@brief	Read an axis: its name, its length and its values in ascending order.
+ *
+ *	@param	file	: Input file.
+ *	@param	name	: Expected name.
+ *	@param	axis	: Receives the axis.
+ *	@return		: `true` if successful.
+ */
+static bool
+surfaceReadAxis(FILE *  file, const char *  name, SurfaceAxis *  axis)
+{
+	char	token[kSurfaceMaxCharsPerToken];
+	double	length;
+
+	axis->values = NULL;
+	if (!surfaceReadToken(file, token) || (strcmp(token, name) != 0) ||
+		!surfaceReadDouble(file, &length) || (length < 1) || (length != floor(length)))
+	{
+		return false;
+	}
+
+	axis->length = (size_t) length;
+	axis->values = (double *) checkedMalloc(axis->length * sizeof(double), __FILE__, __LINE__);
+	for (size_t i = 0; i < axis->length; i++)
+	{
+		if (!surfaceReadDouble(file, &axis->values[i]) || ((i > 0) && (axis->values[i] <= axis->values[i - 1])))
+		{
+			return false;
+		}
+	}
+
+	return surfaceAxisBuildIndex(axis);
+}
+
+CommonConstantReturnType
+surfaceLoad(Surface *  S, const char *  path)
+{
+	char	token[kSurfaceMaxCharsPerToken];
+	size_t	numberOfVoltages;
+	bool	isValid;
+	FILE *	file = fopen(path, "r");
+
+	if (file == NULL)
+	{
+		fprintf(stderr, "Error: Could not open surface file \"%s\".\n", path);
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	*S = (Surface) {0};
+	isValid = surfaceReadAxis(file, "soc", &S->soc) && (S->soc.length >= 2) &&
+		surfaceReadAxis(file, "temperature", &S->temperature) &&
+		surfaceReadAxis(file, "crate", &S->cRate) &&
+		surfaceReadToken(file, token) && (strcmp(token, "voltage") == 0);
+
+	if (isValid)
+	{
+		numberOfVoltages = S->soc.length * S->temperature.length * S->cRate.length;
+		isValid = (numberOfVoltages <= kSurfaceMaxNumberOfVoltages);
+	}
+
+	if (isValid)
+	{
+		S->voltage = (double *) checkedMalloc(numberOfVoltages * sizeof(double), __FILE__, __LINE__);
+		for (size_t i = 0; isValid && (i < numberOfVoltages); i++)
+		{
+			isValid = surfaceReadDouble(file, &S->voltage[i]);
+		}
+	}
+	fclose(file);
+
+	if (!isValid)
+	{
+		fprintf(stderr, "Error: \"%s\" is not a valid surface file.\n", path);
+		surfaceFree(S);
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	surfaceBuildInverseTables(S);
+
+	return kCommonConstantReturnTypeSuccess;
+}
+
+CommonConstantReturnType
+surfaceInitializeFromCurve(Surface *  S, size_t numberOfSocPoints)
+{
+	if ((S == NULL) || (numberOfSocPoints < 2))
+	{
+		fprintf(stderr, "Error: A surface built from the discharge curve needs at least 2 state of charge points.\n");
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	*S = (Surface) {0};
+
+	S->soc.length = numberOfSocPoints;
+	S->soc.values = (double *) checkedMalloc(numberOfSocPoints * sizeof(double), __FILE__, __LINE__);
+	S->temperature.length = 1;
+	S->temperature.values = (double *) checkedMalloc(sizeof(double), __FILE__, __LINE__);
+	S->temperature.values[0] = kSurfaceDefaultTemperature;
+	S->cRate.length = 1;
+	S->cRate.values = (double *) checkedMalloc(sizeof(double), __FILE__, __LINE__);
+	S->cRate.values[0] = kSurfaceDefaultCRate;
+	S->voltage = (double *) checkedMalloc(numberOfSocPoints * sizeof(double), __FILE__, __LINE__);
+
+	for (size_t i = 0; i < numberOfSocPoints; i++)
+	{
+		S->soc.values[i] = (double) i / (numberOfSocPoints - 1);
+		S->voltage[i] = socToVoltage(S->soc.values[i]);
+	}
+
+	if (!surfaceAxisBuildIndex(&S->soc) || !surfaceAxisBuildIndex(&S->temperature) || !surfaceAxisBuildIndex(&S->cRate))
+	{
+		fprintf(stderr, "Error: %zu state of charge points are too many for a surface.\n", numberOfSocPoints);
+		surfaceFree(S);
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	surfaceBuildInverseTables(S);
+
+	return kCommonConstantReturnTypeSuccess;
+}
+
+void
+surfaceFree(Surface *  S)
+{
+	surfaceAxisFree(&S->soc);
+	surfaceAxisFree(&S->temperature);
+	surfaceAxisFree(&S->cRate);
+	free(S->voltage);
+	free(S->inverseVoltageMin);
+	free(S->inverseVoltageScale);
+	free(S->inverseSoc);
+
+	return;
+}
+
+/**
+ *	@brief	Body of `surfaceSocToVoltage`, inlined into the batch loop.
+ */
+static inline double
+surfaceEvaluateSocToVoltage(const Surface *  S, double soc, double temperature, double cRate)
+{
+	int32_t		numberOfSocPoints = (int32_t) S->soc.length;
+	int32_t		numberOfTemperatures = (int32_t) S->temperature.length;
+	double		socWeight;
+	double		temperatureWeight;
+	double		cRateWeight;
+	int32_t		socIndex = surfaceAxisLocate(&S->soc, soc, &socWeight);
+	int32_t		temperatureIndex = surfaceAxisLocate(&S->temperature, temperature, &temperatureWeight);
+	int32_t		cRateIndex = surfaceAxisLocate(&S->cRate, cRate, &cRateWeight);
+
+	/*
+	 *	Offsets to the upper neighbour along each axis; zero for single-point axes.
+	 */
+	int32_t		socStride = 1;
+	int32_t		temperatureStride = numberOfSocPoints * (numberOfTemperatures > 1);
+	int32_t		cRateStride = numberOfSocPoints * numberOfTemperatures * (S->cRate.length > 1);
+	int32_t		offset = (cRateIndex * numberOfTemperatures + temperatureIndex) * numberOfSocPoints + socIndex;
+	const double *	v = S->voltage;
+
+	double		v00 = v[offset] + socWeight * (v[offset + socStride] - v[offset]);
+	double		v10 = v[offset + temperatureStride] +
+				socWeight * (v[offset + temperatureStride + socStride] - v[offset + temperatureStride]);
+	double		v01 = v[offset + cRateStride] +
+				socWeight * (v[offset + cRateStride + socStride] - v[offset + cRateStride]);
+	double		v11 = v[offset + cRateStride + temperatureStride] +
+				socWeight * (v[offset + cRateStride + temperatureStride + socStride] - v[offset + cRateStride + temperatureStride]);
+	double		v0 = v00 + temperatureWeight * (v10 - v00);
+	double		v1 = v01 + temperatureWeight * (v11 - v01);
+
+	return v0 + cRateWeight * (v1 - v0);
+}
+
+double
+surfaceSocToVoltage(const Surface *  S, double soc, double temperature, double cRate)
+{
+	return surfaceEvaluateSocToVoltage(S, soc, temperature, cRate);
+}
+
+/**
+ *	@brief	State of charge at a voltage from the inverse table of one slice.
+ *
+ *	@param	S	: Pointer to surface.
+ *	@param	slice	: Index of the slice.
+ *	@param	voltage	: Voltage.
+ *	@return		: State of charge.
+ */
+static inline double
+surfaceSliceVoltageToSoc(const Surface *  S, int32_t slice, double voltage)
+{
+	const double *	inverseSoc = S->inverseSoc;
+	double		position = (voltage - S->inverseVoltageMin[slice]) * S->inverseVoltageScale[slice];
+	double		lower = surfaceClamp(floor(position), 0, kSurfaceInverseTableSize - 2);
+	double		weight = surfaceClamp(position - lower, 0, 1);
+	int32_t		offset = slice * kSurfaceInverseTableSize + (int32_t) lower;
+
+	return inverseSoc[offset] + weight * (inverseSoc[offset + 1] - inverseSoc[offset]);
+}
+
+/**
+ *	@brief	Body of `surfaceVoltageToSoc`, inlined into the batch loop.
+ */
+static inline double
+surfaceEvaluateVoltageToSoc(const Surface *  S, double voltage, double temperature, double cRate)
+{
+	int32_t	numberOfTemperatures = (int32_t) S->temperature.length;
+	double	temperatureWeight;
+	double	cRateWeight;
+	int32_t	temperatureIndex = surfaceAxisLocate(&S->temperature, temperature, &temperatureWeight);
+	int32_t	cRateIndex = surfaceAxisLocate(&S->cRate, cRate, &cRateWeight);
+	int32_t	slice = cRateIndex * numberOfTemperatures + temperatureIndex;
+	int32_t	temperatureStride = (numberOfTemperatures > 1);
+	int32_t	cRateStride = numberOfTemperatures * (S->cRate.length > 1);
+
+	double	s00 = surfaceSliceVoltageToSoc(S, slice, voltage);
+	double	s10 = surfaceSliceVoltageToSoc(S, slice + temperatureStride, voltage);
+	double	s01 = surfaceSliceVoltageToSoc(S, slice + cRateStride, voltage);
+	double	s11 = surfaceSliceVoltageToSoc(S, slice + cRateStride + temperatureStride, voltage);
+	double	s0 = s00 + temperatureWeight * (s10 - s00);
+	double	s1 = s01 + temperatureWeight * (s11 - s01);
+
+	return s0 + cRateWeight * (s1 - s0);
+}
+
+double
+surfaceVoltageToSoc(const Surface *  S, double voltage, double temperature, double cRate)
+{
+	return surfaceEvaluateVoltageToSoc(S, voltage, temperature, cRate);
+}
+
+void
+surfaceSocToVoltageBatch(
+	const Surface *	S,
+	const double *	socs,
+	const double *	temperatures,
+	const double *	cRates,
+	double * restrict	voltages,
+	size_t		numberOfPoints)
+{
+	/*
+	 *	A local copy lets the compiler keep the axis parameters in registers.
+	 */
+	Surface		surface = *S;
+
+	for (size_t i = 0; i < numberOfPoints; i++)
+	{
+		voltages[i] = surfaceEvaluateSocToVoltage(&surface, socs[i], temperatures[i], cRates[i]);
+	}
+
+	return;
+}
+
+void
+surfaceVoltageToSocBatch(
+	const Surface *	S,
+	const double *	voltages,
+	const double *	temperatures,
+	const double *	cRates,
+	double * restrict	socs,
+	size_t		numberOfPoints)
+{
+	Surface		surface = *S;
+
+	for (size_t i = 0; i < numberOfPoints; i++)
+	{
+		socs[i] = surfaceEvaluateVoltageToSoc(&surface, voltages[i], temperatures[i], cRates[i]);
+	}
+
+	return;
+}
+
+/*
+ *	Context of `surfaceCurve`.
+ */
+typedef struct
+{
+	const Surface *	surface;
+	double		temperature;
+} SurfaceCurveContext;
+
+/**
+ *	@brief	Voltage from a surface at the cell temperature and at the C-rate of the
+ *		current computed in this step (`totalCapacity` is in coulombs), as a `BattCurve`.
+ *
+ *	@param	context	: Pointer to `SurfaceCurveContext`.
+ *	@param	B	: Pointer to battery.
+ *	@return		: Voltage.
+ */
+static double
+surfaceCurve(const void *  context, const Batt *  B)
+{
+	const SurfaceCurveContext *	surfaceContext = (const SurfaceCurveContext *) context;
+
+	return surfaceSocToVoltage(
+			surfaceContext->surface,
+			B->soc,
+			surfaceContext->temperature,
+			B->current * 3600 / B->totalCapacity);
+}
+
+void
+batteryUpdateSurface(
+	Batt *			B,
+	const Surface *		S,
+	double			temperature,
+	double			timeNow,
+	double			currentLoad,
+	double			voltageLoad)
+{
+	SurfaceCurveContext	context = {
+					.surface	= S,
+					.temperature	= temperature,
+				};
+
+	batteryUpdateCurve(B, timeNow, currentLoad, voltageLoad, surfaceCurve, &context);
+
+	return;
+}
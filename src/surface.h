@@ -0,0 +1,194 @@
+/*
+ *	Copyright (c) 2022-2024, Signaloid.
+ *
+ *	Permission is hereby granted, free of charge, to any person obtaining a copy
+ *	of this software and associated documentation files (the "Software"), to deal
+ *	in the Software without restriction, including without limitation the rights
+ *	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *	copies of the Software, and to permit persons to whom the Software is
+ *	furnished to do so, subject to the following conditions:
+ *
+ *	The above copyright notice and this permission notice shall be included in all
+ *	copies or substantial portions of the Software.
+ *
+ *	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *	SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "batt.h"
+#include "common.h"
+
+/*
+ *	A grid axis with an index for locating points without branches: a uniform
+ *	grid of `mapSize` cells over the axis, fine enough that each cell holds at
+ *	most one grid point, maps a point to the grid interval at the start of its
+ *	cell, which is then off by at most one.
+ */
+typedef struct
+{
+	size_t		length;
+	double *	values;
+	size_t		mapSize;
+	double		mapScale;
+	int32_t *	map;
+	double *	intervalEnd;
+	double *	intervalInverseWidth;
+} SurfaceAxis;
+
+/*
+ *	Open-circuit voltage tabulated over (state of charge, temperature, C-rate).
+ *	`voltage` is stored with state of charge fastest, then temperature, then
+ *	C-rate. For every (temperature, C-rate) slice, `inverseSoc` holds the
+ *	state of charge on a uniform voltage grid from `inverseVoltageMin` in
+ *	steps of `1 / inverseVoltageScale`, for the voltage -> state of charge direction.
+ */
+typedef struct
+{
+	SurfaceAxis	soc;
+	SurfaceAxis	temperature;
+	SurfaceAxis	cRate;
+	double *	voltage;
+	double *	inverseVoltageMin;
+	double *	inverseVoltageScale;
+	double *	inverseSoc;
+} Surface;
+
+/**
+ *	@brief	Load a discharge surface from a text file.
+ *
+ *		The file lists the three axes (ascending) and then the voltages, with
+ *		state of charge varying fastest, then temperature, then C-rate:
+ *
+ *			soc <n> <state of charge in [0.0 - 1.0]> ...
+ *			temperature <n> <degrees Celsius> ...
+ *			crate <n> <discharge current / capacity (1/h)> ...
+ *			voltage <voltage (V)> ...
+ *
+ *		Text from `#` to the end of a line is ignored. An axis spanning more
+ *		than 32768 times its smallest spacing is rejected, since its index
+ *		would be too large, as is a surface of more than 8388607 voltages.
+ *
+ *	@param	S	: Pointer to surface.
+ *	@param	path	: Path to the surface file.
+ *	@return		: `kCommonConstantReturnTypeSuccess` if successful, else `kCommonConstantReturnTypeError`.
+ */
+CommonConstantReturnType	surfaceLoad(Surface *  S, const char *  path);
+
+/**
+ *	@brief	Build a single-slice surface from `socToVoltage`, independent of temperature and C-rate.
+ *
+ *		Fewer than 2 points, or more than the axis index allows (about 32769),
+ *		are rejected.
+ *
+ *	@param	S			: Pointer to surface.
+ *	@param	numberOfSocPoints	: Number of grid points in state of charge.
+ *	@return				: `kCommonConstantReturnTypeSuccess` if successful, else `kCommonConstantReturnTypeError`.
+ */
+CommonConstantReturnType	surfaceInitializeFromCurve(Surface *  S, size_t numberOfSocPoints);
+
+/**
+ *	@brief	Free a surface.
+ *
+ *	@param	S	: Pointer to surface.
+ */
+void	surfaceFree(Surface *  S);
+
+/**
+ *	@brief	Voltage at a state of charge, temperature and C-rate, by trilinear interpolation.
+ *
+ *		Inputs outside the grid are clamped to its edges.
+ *
+ *	@param	S		: Pointer to surface.
+ *	@param	soc		: State of charge in [0.0 - 1.0].
+ *	@param	temperature	: Temperature (degrees Celsius).
+ *	@param	cRate		: Discharge C-rate (1/h).
+ *	@return			: Voltage.
+ */
+double	surfaceSocToVoltage(const Surface *  S, double soc, double temperature, double cRate);
+
+/**
+ *	@brief	State of charge at a voltage, temperature and C-rate, by bilinear interpolation
+ *		of the monotone inverse tables of the neighbouring slices.
+ *
+ *	@param	S		: Pointer to surface.
+ *	@param	voltage		: Voltage.
+ *	@param	temperature	: Temperature (degrees Celsius).
+ *	@param	cRate		: Discharge C-rate (1/h).
+ *	@return			: State of charge in [0.0 - 1.0].
+ */
+double	surfaceVoltageToSoc(const Surface *  S, double voltage, double temperature, double cRate);
+
+/**
+ *	@brief	Apply `surfaceSocToVoltage` to a batch.
+ *
+ *		The loop body has no branches and no calls, so with gather
+ *		instructions (e.g., `-O3 -mavx2`) GCC vectorizes it.
+ *
+ *	@param	S		: Pointer to surface.
+ *	@param	socs		: States of charge.
+ *	@param	temperatures	: Temperatures.
+ *	@param	cRates		: C-rates.
+ *	@param	voltages	: Receives the voltages (must not overlap the inputs).
+ *	@param	numberOfPoints	: Number of entries in each array.
+ */
+void	surfaceSocToVoltageBatch(
+		const Surface *	S,
+		const double *	socs,
+		const double *	temperatures,
+		const double *	cRates,
+		double * restrict	voltages,
+		size_t		numberOfPoints);
+
+/**
+ *	@brief	Apply `surfaceVoltageToSoc` to a batch.
+ *
+ *		The loop body has no branches and no calls, but GCC only if-converts
+ *		the clamps of its four inverse-table lookups, and so vectorizes it,
+ *		with `-fno-trapping-math` as well as gather instructions.
+ *
+ *	@param	S		: Pointer to surface.
+ *	@param	voltages	: Voltages.
+ *	@param	temperatures	: Temperatures.
+ *	@param	cRates		: C-rates.
+ *	@param	socs		: Receives the states of charge (must not overlap the inputs).
+ *	@param	numberOfPoints	: Number of entries in each array.
+ */
+void	surfaceVoltageToSocBatch(
+		const Surface *	S,
+		const double *	voltages,
+		const double *	temperatures,
+		const double *	cRates,
+		double * restrict	socs,
+		size_t		numberOfPoints);
+
+/**
+ *	@brief	Update battery, with the discharge characteristic taken from a surface.
+ *
+ *		As `batteryUpdate`, but the battery voltage is looked up at the cell
+ *		temperature and at the C-rate of the current computed in this step.
+ *
+ *	@param	B		: Pointer to battery.
+ *	@param	S		: Pointer to surface.
+ *	@param	temperature	: Cell temperature (degrees Celsius).
+ *	@param	timeNow		: Current time.
+ *	@param	currentLoad	: Current at load.
+ *	@param	voltageLoad	: Voltage at load.
+ */
+void	batteryUpdateSurface(
+		Batt *			B,
+		const Surface *		S,
+		double			temperature,
+		double			timeNow,
+		double			currentLoad,
+		double			voltageLoad);
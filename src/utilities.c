@@ -54,7 +54,14 @@ printUsage(void)
 		"\t[-b, --benchmarking] (Benchmarking mode: Generate outputs in format for benchmarking.)\n"
 		"\t[-j, --json] (Print output in JSON format.)\n"
 		"\t[-h, --help] (Display this help message.)\n"
+		"\t[-i, --input <Path to input file : str>] (Pipelined mode: Estimate the state of charge for every measured voltage in the file, one per line.)\n"
+		"\t[-W, --workers <Number of workers : int> (Default: %d)] (Number of estimator threads in pipelined mode.)\n"
+		"\t[-H, --harness] (Harness mode: Print accuracy against a reference and runtime for a sweep of iteration counts, sampling schemes and evaluation modes.)\n"
+		"\t[-R, --reference <Path to reference samples file : str>] (Reference state of charge samples for harness mode, one per line. Default: generated.)\n"
+		"\t[-F, --fleet-benchmark <Number of cells : int>] (Fleet benchmark mode: Print the per-cell cost of fleet-scale operations.)\n"
+		"\t[-P, --profile <Path to counters file : str>] (Write hot-path counters at exit and on SIGUSR1, as Prometheus text if the path ends in .prom, else JSON. Requires building with -DBATT_ENABLE_COUNTERS.)\n"
 		"\t[-V, --measuredVoltage <Measured voltage of battery : double> (Default: Gauss(%" SignaloidParticleModifier ".2lf, %" SignaloidParticleModifier ".2lf))] (Set input measured voltage.)\n",
+		kDemoSpecificConstantDefaultNumberOfPipelineWorkers,
 		kDemoSpecificConstantMeasuredVoltageGaussianMean,
 		kDemoSpecificConstantMeasuredVoltageGaussianStandardDeviation);
 	fprintf(stderr, "\n");
@@ -85,8 +92,9 @@ setDefaultCommandLineArguments(CommandLineArguments *  arguments)
 
 	*arguments = (CommandLineArguments)
 	{
-		.common			= (CommonCommandLineArguments) {0},
-		.measuredVoltage	= getDefaultMeasuredVoltage(),
+		.common				= (CommonCommandLineArguments) {0},
+		.measuredVoltage		= getDefaultMeasuredVoltage(),
+		.numberOfPipelineWorkers	= kDemoSpecificConstantDefaultNumberOfPipelineWorkers,
 	};
 #pragma GCC diagnostic pop
 
@@ -99,6 +107,10 @@ CommonConstantReturnType
 getCommandLineArguments(int argc, char *  argv[], CommandLineArguments *  arguments)
 {
 	const char *	measuredVoltageArg = NULL;
+	const char *	workersArg = NULL;
+	const char *	referenceArg = NULL;
+	const char *	fleetBenchmarkArg = NULL;
+	const char *	profileArg = NULL;
 	const char	kConstantStringUx[] = "Ux";
 
 	if (arguments == NULL)
@@ -116,6 +128,11 @@ getCommandLineArguments(int argc, char *  argv[], CommandLineArguments *  argume
 	DemoOption	options[] =
 	{
 			{ .opt = "V",	.optAlternative = "measuredVoltage",	.hasArg = true,	.foundArg = &measuredVoltageArg,	.foundOpt = NULL },
+			{ .opt = "W",	.optAlternative = "workers",		.hasArg = true,	.foundArg = &workersArg,		.foundOpt = NULL },
+			{ .opt = "H",	.optAlternative = "harness",		.hasArg = false,	.foundArg = NULL,			.foundOpt = &arguments->isHarnessMode },
+			{ .opt = "R",	.optAlternative = "reference",		.hasArg = true,	.foundArg = &referenceArg,		.foundOpt = NULL },
+			{ .opt = "F",	.optAlternative = "fleet-benchmark",	.hasArg = true,	.foundArg = &fleetBenchmarkArg,		.foundOpt = NULL },
+			{ .opt = "P",	.optAlternative = "profile",		.hasArg = true,	.foundArg = &profileArg,		.foundOpt = NULL },
 			{0},
 	};
 
@@ -134,9 +151,16 @@ getCommandLineArguments(int argc, char *  argv[], CommandLineArguments *  argume
 		exit(EXIT_SUCCESS);
 	}
 
-	if (arguments->common.isInputFromFileEnabled)
+	if (arguments->common.isInputFromFileEnabled && arguments->common.isMonteCarloMode)
 	{
-		fprintf(stderr, "Error: This application does not support reading inputs from file.\n");
+		fprintf(stderr, "Error: Native Monte Carlo is not compatible with pipelined input from file.\n");
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	if (arguments->common.isInputFromFileEnabled && (arguments->common.isOutputJSONMode || arguments->common.isBenchmarkingMode))
+	{
+		fprintf(stderr, "Error: JSON output and benchmarking mode are not compatible with pipelined input from file.\n");
 
 		return kCommonConstantReturnTypeError;
 	}
@@ -179,6 +203,81 @@ getCommandLineArguments(int argc, char *  argv[], CommandLineArguments *  argume
 		arguments->isMeasuredVoltageSet = true;
 	}
 
+	if (arguments->isMeasuredVoltageSet && arguments->isHarnessMode)
+	{
+		fprintf(stderr, "Error: The measuredVoltage parameter(-V) is not used in harness mode(-H), which sweeps the default Gaussian input.\n");
+		printUsage();
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	if (arguments->isMeasuredVoltageSet && arguments->common.isInputFromFileEnabled)
+	{
+		fprintf(stderr, "Error: The measuredVoltage parameter(-V) is not used with pipelined input from file(-i), which reads the voltages from the file.\n");
+		printUsage();
+
+		return kCommonConstantReturnTypeError;
+	}
+
+	if (workersArg != NULL)
+	{
+		int	numberOfPipelineWorkers;
+
+		if (!arguments->common.isInputFromFileEnabled)
+		{
+			fprintf(stderr, "Error: The workers parameter(-W) is only used with pipelined input from file(-i).\n");
+			printUsage();
+
+			return kCommonConstantReturnTypeError;
+		}
+
+		if ((parseIntChecked(workersArg, &numberOfPipelineWorkers) != kCommonConstantReturnTypeSuccess) || (numberOfPipelineWorkers < 1))
+		{
+			fprintf(stderr, "Error: The workers parameter(-W) must be a positive integer.\n");
+			printUsage();
+
+			return kCommonConstantReturnTypeError;
+		}
+
+		arguments->numberOfPipelineWorkers = numberOfPipelineWorkers;
+	}
+
+	if (referenceArg != NULL)
+	{
+		if (!arguments->isHarnessMode)
+		{
+			fprintf(stderr, "Error: The reference parameter(-R) is only used in harness mode(-H).\n");
+			printUsage();
+
+			return kCommonConstantReturnTypeError;
+		}
+
+		snprintf(arguments->referenceFilePath, kCommonConstantMaxCharsPerFilepath, "%s", referenceArg);
+		arguments->isReferenceFileSet = true;
+	}
+
+	if (fleetBenchmarkArg != NULL)
+	{
+		int	numberOfFleetBenchmarkCells;
+
+		if ((parseIntChecked(fleetBenchmarkArg, &numberOfFleetBenchmarkCells) != kCommonConstantReturnTypeSuccess) || (numberOfFleetBenchmarkCells < 1))
+		{
+			fprintf(stderr, "Error: The fleet-benchmark parameter(-F) must be a positive integer.\n");
+			printUsage();
+
+			return kCommonConstantReturnTypeError;
+		}
+
+		arguments->numberOfFleetBenchmarkCells = numberOfFleetBenchmarkCells;
+		arguments->isFleetBenchmarkMode = true;
+	}
+
+	if (profileArg != NULL)
+	{
+		snprintf(arguments->profileFilePath, kCommonConstantMaxCharsPerFilepath, "%s", profileArg);
+		arguments->isProfileFileSet = true;
+	}
+
 	return kCommonConstantReturnTypeSuccess;
 }
 
@@ -36,12 +36,21 @@ typedef enum
 
 #define	kDemoSpecificConstantMeasuredVoltageGaussianMean		(3.7)
 #define	kDemoSpecificConstantMeasuredVoltageGaussianStandardDeviation	(0.01)
+#define	kDemoSpecificConstantDefaultNumberOfPipelineWorkers		(1)
 
 typedef struct CommandLineArguments
 {
 	CommonCommandLineArguments	common;
 	double				measuredVoltage;
 	bool				isMeasuredVoltageSet;
+	size_t				numberOfPipelineWorkers;
+	bool				isHarnessMode;
+	bool				isReferenceFileSet;
+	char				referenceFilePath[kCommonConstantMaxCharsPerFilepath];
+	bool				isFleetBenchmarkMode;
+	size_t				numberOfFleetBenchmarkCells;
+	bool				isProfileFileSet;
+	char				profileFilePath[kCommonConstantMaxCharsPerFilepath];
 } CommandLineArguments;
 
 /**